@@ -1,16 +1,95 @@
 #ifndef _CONFIG_H_
 #define _CONFIG_H_
 
-// we use only one HART (cpu) in fundamental experiments
-#define NCPU 1
+// maximum number of HARTs (cpus) the kernel runs on (spike -p<n>). harts with larger
+// ids are parked at boot.
+#define NCPU 4
 
 //interval of timer interrupt. added @lab1_3
 #define TIMER_INTERVAL 1000000
 
+// tickless mode: instead of ticking every TIMER_INTERVAL, the timer of a hart is set to
+// the next event it has to handle (cf. program_timer() in kernel/strap.c). a hart
+// running one process alone, or none, gets no ticks.
+#define TIMER_TICKLESS 1
+
+// frequency of mtime (the time csr) on spike, in Hz
+#define TIMEBASE_FREQ 10000000
+
+// resolution of the kernel timers (kernel/timer.c), in mtime units: 1ms
+#define TIMER_WHEEL_RES (TIMEBASE_FREQ / 1000)
+
 // the maximum memory space that PKE is allowed to manage. added @lab2_1
 #define PKE_MAX_ALLOWABLE_RAM 128 * 1024 * 1024
 
+// preferred paging mode, 39 or 48. Sv48 is used only if the hart supports it.
+#define PKE_PAGING_MODE 48
+
 // the ending physical address that PKE observes. added @lab2_1
 #define PHYS_TOP (DRAM_BASE + PKE_MAX_ALLOWABLE_RAM)
 
+// interval of the working-set (accessed/dirty bit) scanner, in number of timer ticks
+#define WSS_SCAN_INTERVAL 5
+
+// samepage merging (kernel/ksm.c): scan interval in ticks, and pages scanned per run
+#define KSM_SCAN_INTERVAL 10
+#define KSM_PAGES_TO_SCAN 64
+
+// compressed page store (kernel/zram.c). pages not accessed for ZRAM_COLD_SCANS
+// working-set scans are compressed once free memory drops below ZRAM_FREE_WATERMARK
+// pages. the store may grow up to ZRAM_POOL_PAGES physical pages.
+#define ZRAM_COLD_SCANS 4
+#define ZRAM_FREE_WATERMARK (PKE_MAX_ALLOWABLE_RAM / PGSIZE / 8)
+#define ZRAM_POOL_PAGES 1024
+
+// default per-process memory limits, in pages (0 for no limit). above the soft limit a
+// process has its resident set reclaimed into the compressed store, allocations that
+// would take it above the hard limit fail.
+#define PROC_MEM_SOFT_LIMIT 0
+#define PROC_MEM_HARD_LIMIT (PKE_MAX_ALLOWABLE_RAM / PGSIZE / 4)
+
+// default scheduling policy (kernel/sched.c), one of:
+//   SCHED_RR:   round-robin, every process gets TIME_SLICE_LEN ticks.
+//   SCHED_MLFQ: multi-level feedback queue (kernel/sched_mlfq.c).
+//   SCHED_CFS:  proportional share by virtual runtime (kernel/sched_fair.c).
+// it can be overridden at boot with "sched=rr|mlfq|cfs" in the bootargs.
+#define SCHED_RR   0
+#define SCHED_MLFQ 1
+#define SCHED_CFS  2
+#define SCHED_POLICY SCHED_MLFQ
+
+// MLFQ: number of priority levels (0 is the highest), and the interval (in ticks) of
+// the periodic boost that moves every process back to level 0. the quantum of level l
+// is TIME_SLICE_LEN << l ticks.
+#define MLFQ_LEVELS 3
+#define MLFQ_BOOST_INTERVAL 50
+
+// CFS: the period in which every runnable process runs once, and the shortest slice,
+// in mtime units (as TIMER_INTERVAL). a process waking up is placed at most
+// CFS_SLEEPER_CREDIT behind the smallest virtual runtime of the run queue.
+#define CFS_SCHED_LATENCY (6 * TIMER_INTERVAL)
+#define CFS_MIN_GRANULARITY TIMER_INTERVAL
+#define CFS_SLEEPER_CREDIT (CFS_SCHED_LATENCY / 2)
+
+// load balancing between harts: hart 0 evens out the run queues every
+// SCHED_REBALANCE_INTERVAL ticks. a process that stopped running less than
+// SCHED_MIGRATION_COST (mtime units) ago is cache hot, and stays on its hart then.
+#define SCHED_REBALANCE_INTERVAL 4
+#define SCHED_MIGRATION_COST (TIMER_INTERVAL / 2)
+
+// EDF real-time processes (kernel/sched_dl.c) run before all others. they are admitted
+// only while their total utilization (runtime / period) stays within DL_BW_LIMIT
+// percent of the processor.
+#define DL_BW_LIMIT 95
+
+// an idle hart zeroes free pages ahead of time, IDLE_ZERO_BATCH at a time, until
+// PMM_ZERO_POOL_PAGES of them are ready for alloc_zeroed_page().
+#define IDLE_ZERO_BATCH 4
+#define PMM_ZERO_POOL_PAGES 256
+
+// reaped processes leave their page directory (with the trapframe and the trap vector
+// still mapped), trapframe, kernel stack and mapped_info page in a per-hart cache of up
+// to PROC_SKEL_CACHE_SIZE entries, which alloc_process() takes them from.
+#define PROC_SKEL_CACHE_SIZE 8
+
 #endif
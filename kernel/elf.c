@@ -24,11 +24,12 @@ static void *elf_alloc_mb(elf_ctx *ctx, uint64 elf_pa, uint64 elf_va, uint64 siz
   // we assume that size of proram segment is smaller than a page.
   kassert(size < PGSIZE);
   void *pa = alloc_page();
-  if (pa == 0) panic("uvmalloc mem alloc falied\n");
+  if (pa == 0) return NULL;
 
   memset((void *)pa, 0, PGSIZE);
-  user_vm_map((pagetable_t)msg->p->pagetable, elf_va, PGSIZE, (uint64)pa,
-         prot_to_type(PROT_WRITE | PROT_READ | PROT_EXEC, 1));
+  mm_charge(msg->p, MM_RSS, 1);
+  mm_charge(msg->p, MM_PAGETABLE, user_vm_map((pagetable_t)msg->p->pagetable, elf_va, PGSIZE,
+         (uint64)pa, prot_to_type(PROT_WRITE | PROT_READ | PROT_EXEC, 1)));
 
   return pa;
 }
@@ -78,6 +79,7 @@ elf_status elf_load(elf_ctx *ctx) {
 
     // allocate memory block before elf loading
     void *dest = elf_alloc_mb(ctx, ph_addr.vaddr, ph_addr.vaddr, ph_addr.memsz);
+    if (dest == NULL) return EL_ENOMEM;
 
     // actual loading
     if (elf_fpread(ctx, dest, ph_addr.memsz, ph_addr.off) != ph_addr.memsz)
@@ -98,8 +100,10 @@ elf_status elf_load(elf_ctx *ctx) {
     }else if ( ph_addr.flags == (SEGMENT_READABLE|SEGMENT_WRITABLE) ){
       ((process*)(((elf_info*)(ctx->info))->p))->mapped_info[j].seg_type = DATA_SEGMENT;
       sprint( "DATA_SEGMENT added at mapped info offset:%d\n", j );
-    }else
-      panic( "unknown program segment encountered, segment flag:%d.\n", ph_addr.flags );
+    }else{
+      sprint( "unknown program segment encountered, segment flag:%d.\n", ph_addr.flags );
+      return EL_ERR;
+    }
 
     ((process*)(((elf_info*)(ctx->info))->p))->total_mapped_region ++;
   }
@@ -134,39 +138,52 @@ static size_t parse_args(arg_buf *arg_bug_msg) {
 }
 
 //
-// load the elf of user application, by using the spike file interface.
+// load the elf at "path" on the host into the address space of process p, which has no
+// code or data yet, by using the spike file interface. sets the entry point of p.
 //
-void load_bincode_from_host_elf(process *p) {
-  arg_buf arg_bug_msg;
-
-  // retrieve command line arguements
-  size_t argc = parse_args(&arg_bug_msg);
-  if (!argc) panic("You need to specify the application program!\n");
-
-  sprint("Application: %s\n", arg_bug_msg.argv[0]);
-
+elf_status load_elf_from_host(process *p, const char *path) {
   //elf loading. elf_ctx is defined in kernel/elf.h, used to track the loading process.
   elf_ctx elfloader;
   // elf_info is defined above, used to tie the elf file and its corresponding process.
   elf_info info;
 
-  info.f = spike_file_open(arg_bug_msg.argv[0], O_RDONLY, 0);
+  info.f = spike_file_open(path, O_RDONLY, 0);
   info.p = p;
   // IS_ERR_VALUE is a macro defined in spike_interface/spike_htif.h
-  if (IS_ERR_VALUE(info.f)) panic("Fail on openning the input application program.\n");
+  if (IS_ERR_VALUE(info.f)) return EL_EIO;
 
-  // init elfloader context. elf_init() is defined above.
-  if (elf_init(&elfloader, &info) != EL_OK)
-    panic("fail to init elfloader.\n");
-
-  // load elf. elf_load() is defined above.
-  if (elf_load(&elfloader) != EL_OK) panic("Fail on loading elf.\n");
+  // init elfloader context, and load elf. elf_init() and elf_load() are defined above.
+  elf_status r = elf_init(&elfloader, &info);
+  if (r == EL_OK) r = elf_load(&elfloader);
 
   // entry (virtual, also physical in lab1_x) address
-  p->trapframe->epc = elfloader.ehdr.entry;
+  if (r == EL_OK) p->trapframe->epc = elfloader.ehdr.entry;
 
   // close the host spike file
   spike_file_close( info.f );
+  return r;
+}
+
+//
+// load the elf of user application, by using the spike file interface.
+//
+void load_bincode_from_host_elf(process *p) {
+  arg_buf arg_bug_msg;
+
+  // retrieve command line arguements
+  size_t argc = parse_args(&arg_bug_msg);
+  if (!argc) panic("You need to specify the application program!\n");
+
+  sprint("Application: %s\n", arg_bug_msg.argv[0]);
+
+  switch (load_elf_from_host(p, arg_bug_msg.argv[0])) {
+    case EL_OK:
+      break;
+    case EL_EIO:
+      panic("Fail on openning the input application program.\n");
+    default:
+      panic("Fail on loading elf.\n");
+  }
 
   sprint("Application program entry point (virtual address): 0x%lx\n", p->trapframe->epc);
 }
@@ -63,6 +63,7 @@ typedef struct elf_ctx_t {
 elf_status elf_init(elf_ctx *ctx, void *info);
 elf_status elf_load(elf_ctx *ctx);
 
+elf_status load_elf_from_host(process *p, const char *path);
 void load_bincode_from_host_elf(process *p);
 
 #endif
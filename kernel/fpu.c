@@ -0,0 +1,68 @@
+/*
+ * Lazy switching of the floating-point registers.
+ *
+ * Most processes never touch the FP registers, so they are not saved and restored on
+ * every switch. The FP registers of a hart hold the state of one process at a time, its
+ * owner. Another process returns to user mode with sstatus.FS Off, so that its first FP
+ * instruction traps, and only then its state is loaded (cf. fpu_trap()). The state is
+ * saved when its owner is switched out, and only if the hardware marked it Dirty.
+ */
+
+#include "fpu.h"
+#include "riscv.h"
+#include "spike_interface/spike_utils.h"
+
+// the process whose FP state is loaded in the FP registers of each hart. it is loaded
+// only if the process also has fp_cpu set to the hart, as it may have run elsewhere.
+static process *g_fp_owner[NCPU];
+
+#define fp_loaded(p) (g_fp_owner[cpuid()] == (p) && (p)->fp_cpu == cpuid())
+
+static void set_fs(uint64 fs) {
+  write_csr(sstatus, (read_csr(sstatus) & ~SSTATUS_FS) | fs);
+}
+
+//
+// the FS bits of sstatus for returning to user mode in process p. if p still owns the FP
+// registers of this hart, they stay usable: Dirty if p changed them since it trapped
+// into the kernel, otherwise Clean, as an owner switched out was saved by fpu_flush().
+//
+uint64 fpu_user_fs(process *p) {
+  if (!fp_loaded(p)) return SSTATUS_FS_OFF;
+  return (read_csr(sstatus) & SSTATUS_FS) == SSTATUS_FS_DIRTY ? SSTATUS_FS_DIRTY
+                                                              : SSTATUS_FS_CLEAN;
+}
+
+//
+// an illegal instruction trapped in process p. with FS Off, it may be an FP instruction:
+// load the FP state of p, so that the instruction succeeds when it is executed again.
+// the state of the previous owner was saved when it was switched out. returns 0 if the
+// FP registers were usable already, so the instruction is illegal indeed.
+//
+int fpu_trap(process *p) {
+  if ((read_csr(sstatus) & SSTATUS_FS) != SSTATUS_FS_OFF) return 0;
+
+  set_fs(SSTATUS_FS_CLEAN);
+  fp_restore(&p->fp);
+  // the loads marked the state Dirty, but it is the saved one.
+  set_fs(SSTATUS_FS_CLEAN);
+  g_fp_owner[cpuid()] = p;
+  p->fp_cpu = cpuid();
+  return 1;
+}
+
+//
+// p is switched out (or forked): save its FP registers, if they are loaded on this hart
+// and hold changes. they stay loaded, and are used again if p comes back to this hart
+// before another process takes them.
+//
+void fpu_flush(process *p) {
+  if (!fp_loaded(p) || (read_csr(sstatus) & SSTATUS_FS) != SSTATUS_FS_DIRTY) return;
+  fp_save(&p->fp);
+  set_fs(SSTATUS_FS_CLEAN);
+}
+
+void fpu_release(process *p) {
+  if (p->fp_cpu >= 0 && g_fp_owner[p->fp_cpu] == p) g_fp_owner[p->fp_cpu] = NULL;
+  p->fp_cpu = -1;
+}
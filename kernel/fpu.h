@@ -0,0 +1,21 @@
+#ifndef _FPU_H_
+#define _FPU_H_
+
+#include "process.h"
+
+// save the FP registers (f0-f31, fcsr) into *fp, and load them from *fp (kernel/fp.S).
+// sstatus.FS must not be Off.
+void fp_save(fp_state *fp);
+void fp_restore(fp_state *fp);
+
+// the FS bits of sstatus to return to user mode in p with
+uint64 fpu_user_fs(process *p);
+// a trap on an illegal instruction of p: returns non-zero if it was its first FP
+// instruction since it got the hart, and its FP state is loaded now
+int fpu_trap(process *p);
+// save the FP registers of p, if they are loaded on this hart and were changed
+void fpu_flush(process *p);
+// p exits, its FP state is not needed anymore
+void fpu_release(process *p);
+
+#endif
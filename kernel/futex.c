@@ -0,0 +1,88 @@
+/*
+ * Futexes: blocking on an int in user memory, for the locks of user/user_lib.c that
+ * enter the kernel only when they are contended.
+ *
+ * A futex is known by the physical address of the int, so that processes mapping the
+ * same page at different addresses agree on it. The waiters are kept in a table of wait
+ * queues hashed by that address. The page is pinned while a process waits on it, so it
+ * is neither merged (kernel/ksm.c) nor compressed (kernel/zram.c) meanwhile, which
+ * would move the futex to another physical address.
+ */
+
+#include "futex.h"
+#include "sched.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "timer.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+#define FUTEX_BUCKETS 64
+
+static wait_queue g_futex_queues[FUTEX_BUCKETS];
+
+#define futex_queue(key) (&g_futex_queues[((key) >> 2) % FUTEX_BUCKETS])
+
+//
+// the timeout of a futex wait passed.
+//
+static void futex_timeout(timer *t) {
+  if (t->proc->status == BLOCKED) insert_to_ready_queue(t->proc);
+}
+
+//
+// returns 0 if woken up by futex_wake(), -1 if the futex did not hold val (or uaddr is
+// not a mapped int), or the timeout passed first.
+//
+int futex_wait(uint64 uaddr, int val, uint64 timeout) {
+  if (uaddr & 3) return -1;
+  // a merged page gets a private copy first, as its frame is the futex.
+  if (user_vm_break_cow(current->pagetable, uaddr) < 0) return -1;
+  int *pa = (int *)user_va_to_pa(current->pagetable, (void *)uaddr);
+  if (pa == NULL || *pa != val) return -1;
+
+  get_page((void *)ROUNDDOWN((uint64)pa, PGSIZE));
+  current->futex_key = (uint64)pa;
+  if (timeout) {
+    timer_setup(&current->sleep_timer, futex_timeout, current);
+    add_timer(&current->sleep_timer, read_csr(time) + timeout);
+  }
+  sleep_on(futex_queue((uint64)pa));
+
+  del_timer(&current->sleep_timer);
+  put_page((void *)ROUNDDOWN((uint64)pa, PGSIZE));
+  // futex_wake() clears the key of the processes it wakes up.
+  int woken = (current->futex_key == 0);
+  current->futex_key = 0;
+  return woken ? 0 : -1;
+}
+
+//
+// returns the number of processes woken up.
+//
+int futex_wake(uint64 uaddr, int n) {
+  if (uaddr & 3) return -1;
+  uint64 key = (uint64)user_va_to_pa(current->pagetable, (void *)uaddr);
+  if (key == 0) return -1;
+
+  wait_queue *q = futex_queue(key);
+  int woken = 0;
+  for (process *p = q->head, *next; p && woken < n; p = next) {
+    next = p->queue_next;
+    if (p->futex_key != key) continue;
+    p->futex_key = 0;
+    insert_to_ready_queue(p);
+    woken++;
+  }
+  return woken;
+}
+
+//
+// a process killed while waiting exits from within futex_wait() (cf. schedule()), and
+// drops its pin on the page of the futex here.
+//
+void futex_exit(process *p) {
+  if (p->futex_key == 0) return;
+  put_page((void *)ROUNDDOWN(p->futex_key, PGSIZE));
+  p->futex_key = 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+#include "process.h"
+
+// block the current process while the int at user address uaddr holds val, until
+// futex_wake() on it, or timeout (mtime units, 0 for none) passes.
+int futex_wait(uint64 uaddr, int val, uint64 timeout);
+// wake up to n processes waiting on the int at user address uaddr
+int futex_wake(uint64 uaddr, int n);
+// p exits while waiting on a futex
+void futex_exit(process *p);
+
+#endif
@@ -10,7 +10,10 @@
 #include "vmm.h"
 #include "sched.h"
 #include "memlayout.h"
+#include "smp.h"
+#include "strap.h"
 #include "spike_interface/spike_utils.h"
+#include "spike_interface/atomic.h"
 
 //
 // trap_sec_start points to the beginning of S-mode trap segment (i.e., the entry point of
@@ -25,6 +28,17 @@ void enable_paging() {
   // write the pointer to kernel page (table) directory into the CSR of "satp".
   write_csr(satp, MAKE_SATP(g_kernel_pagetable));
 
+  // satp is WARL: writing an unsupported mode has no effect at all, and we are still
+  // in Bare mode. in that case the hart lacks Sv48, so rebuild the kernel page table
+  // for Sv39. (if the write did take effect, the identity-mapped kernel just goes on.)
+  if ((read_csr(satp) & SATP_MODE_MASK) != g_satp_mode) {
+    sprint("Sv48 is not supported by the hart, falling back to Sv39.\n");
+    free_pagetable(g_kernel_pagetable);
+    vm_set_mode(SATP_SV39);
+    kern_vm_init();
+    write_csr(satp, MAKE_SATP(g_kernel_pagetable));
+  }
+
   // refresh tlb to invalidate its content.
   flush_tlb();
 }
@@ -37,41 +51,77 @@ process* load_user_program() {
   process* proc;
 
   proc = alloc_process();
+  if (proc == NULL) panic("cannot allocate the first process.\n");
   sprint("User application is loading.\n");
 
   load_bincode_from_host_elf(proc);
   return proc;
 }
 
+// set by hart 0 once the kernel is initialized, the other harts wait for it.
+static volatile int g_kernel_ready = 0;
+
+//
+// S-mode entry of the harts other than hart 0: they share the kernel page table built
+// by hart 0, and then wait in the scheduler for processes to run.
+//
+static void s_start_secondary(void) {
+  write_csr(stvec, (uint64)kernel_trap_vector);
+  while (!g_kernel_ready)
+    ;
+
+  write_csr(satp, MAKE_SATP(g_kernel_pagetable));
+  flush_tlb();
+
+  kernel_lock();
+  smp_cpu_up(cpuid());
+  sprint("hart %d: kernel page table is on \n", cpuid());
+  sched_start();
+}
+
 //
 // s_start: S-mode entry point of riscv-pke OS kernel.
 //
 int s_start(void) {
-  sprint("Enter supervisor mode...\n");
   // in the beginning, we use Bare mode (direct) memory mapping as in lab1.
   // but now, we are going to switch to the paging mode @lab2_1.
   // note, the code still works in Bare mode when calling pmm_init() and kern_vm_init().
   write_csr(satp, 0);
+  // a trap in the kernel is fatal, and reported (cf. kernel/kernel_vector.S).
+  write_csr(stvec, (uint64)kernel_trap_vector);
+
+  // hart 0 initializes the kernel.
+  if (cpuid() != 0) s_start_secondary();
+  sprint("Enter supervisor mode...\n");
 
   // init phisical memory manager
   pmm_init();
 
-  // build the kernel page table
+  // build the kernel page table, in the preferred paging mode
+  vm_set_mode(PKE_PAGING_MODE == 48 ? SATP_SV48 : SATP_SV39);
   kern_vm_init();
 
-  // now, switch to paging mode by turning on paging (SV39)
+  // now, switch to paging mode by turning on paging (SV39 or SV48)
   enable_paging();
+  sprint("paging mode: Sv%d\n", g_pt_levels == 4 ? 48 : 39);
   // the code now formally works in paging mode, meaning the page table is now in use.
   sprint("kernel page table is on \n");
 
   // added @lab3_1
   init_proc_pool();
+  sched_init();
+
+  // let the other harts in.
+  kernel_lock();
+  smp_cpu_up(0);
+  mb();
+  g_kernel_ready = 1;
 
   sprint("Switch to user mode...\n");
   // the application code (elf) is first loaded into memory, and then put into execution
   // added @lab3_1
   insert_to_ready_queue( load_user_program() );
-  schedule();
+  sched_start();
 
   // we should never reach here.
   return 0;
@@ -0,0 +1,48 @@
+/*
+ * Object caches for kernel structures that are allocated and freed often, e.g., the
+ * process structures (kernel/process.c).
+ */
+
+#include "kmem.h"
+#include "pmm.h"
+#include "riscv.h"
+#include "util/string.h"
+#include "spike_interface/spike_utils.h"
+
+//
+// take a free page, and cut it into objects for cache c.
+//
+static int kmem_cache_grow(kmem_cache *c) {
+  char *page = alloc_page();
+  if (page == NULL) return -1;
+
+  for (uint64 off = 0; off + c->size <= PGSIZE; off += c->size) {
+    *(void **)(page + off) = c->free;
+    c->free = page + off;
+  }
+  c->nr_pages++;
+  return 0;
+}
+
+//
+// allocate a zero-filled object from cache c. returns NULL if out of memory.
+//
+void *kmem_cache_alloc(kmem_cache *c) {
+  if (c->size > PGSIZE) panic("kmem_cache %s: objects larger than a page.\n", c->name);
+  if (c->free == NULL && kmem_cache_grow(c) < 0) return NULL;
+
+  void *obj = c->free;
+  c->free = *(void **)obj;
+  c->nr_inuse++;
+  memset(obj, 0, c->size);
+  return obj;
+}
+
+//
+// give obj back to cache c.
+//
+void kmem_cache_free(kmem_cache *c, void *obj) {
+  *(void **)obj = c->free;
+  c->free = obj;
+  c->nr_inuse--;
+}
@@ -0,0 +1,21 @@
+#ifndef _KMEM_H_
+#define _KMEM_H_
+
+#include "util/types.h"
+
+// a cache of kernel objects of one size, carved out of whole pages. freed objects are
+// kept in the cache for reuse, its pages are never given back.
+typedef struct kmem_cache_t {
+  const char *name;
+  uint64 size;      // object size, a multiple of 8
+  void *free;       // free objects, linked through their first word
+  uint64 nr_pages;  // pages taken from the page allocator
+  uint64 nr_inuse;  // objects handed out
+} kmem_cache;
+
+#define KMEM_CACHE_INIT(name, type) { name, (sizeof(type) + 7) & ~7UL, NULL, 0, 0 }
+
+void *kmem_cache_alloc(kmem_cache *c);
+void kmem_cache_free(kmem_cache *c, void *obj);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * Kernel samepage merging for identical anonymous pages.
+ *
+ * Processes opt in by SYS_user_set_mergeable. Every KSM_SCAN_INTERVAL ticks, ksm_scan()
+ * visits up to KSM_PAGES_TO_SCAN private writable pages of the mergeable processes and
+ * looks them up by checksum:
+ *  - in the stable table, whose frames are already shared read-only. on a byte-for-byte
+ *    match, the page is remapped to the stable frame and its own frame is released.
+ *  - in the unstable table, holding pages seen earlier in the current pass. on a match,
+ *    the earlier page is write-protected and promoted to a stable frame first.
+ * merged mappings are marked PTE_COW, and a write to them gets a private copy again
+ * (cf. user_vm_break_cow() in kernel/vmm.c). stable frames hold a reference of their
+ * own, which is dropped once no mapping shares them anymore.
+ */
+
+#include "ksm.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "riscv.h"
+#include "config.h"
+#include "util/string.h"
+#include "spike_interface/spike_utils.h"
+
+#define KSM_MAX_NODES 1024
+#define KSM_BUCKETS 256
+
+typedef struct ksm_node_t {
+  uint32 checksum;
+  int stable;          // stable frames are shared read-only, unstable ones are not
+  uint64 pa;
+  // owner of an unstable page, used to check that it is still mapped the same way.
+  process *owner;
+  uint64 va;
+  int next;            // next node in the same bucket, or in the free list
+} ksm_node;
+
+static ksm_node g_nodes[KSM_MAX_NODES];
+static int g_buckets[KSM_BUCKETS];
+static int g_free_node = -1;
+static int g_ksm_ready = 0;
+
+// where the next run continues the pass over all mergeable processes.
+static int64 g_cursor_pid = 0;
+static uint64 g_cursor_va = 0;
+
+// statistics.
+static uint64 g_pages_shared = 0;   // stable frames in use
+static uint64 g_pages_merged = 0;   // mappings merged into stable frames so far
+static uint64 g_full_scans = 0;
+
+static void ksm_init() {
+  for (int i = 0; i < KSM_BUCKETS; i++) g_buckets[i] = -1;
+  for (int i = 0; i < KSM_MAX_NODES; i++) g_nodes[i].next = i + 1;
+  g_nodes[KSM_MAX_NODES - 1].next = -1;
+  g_free_node = 0;
+  g_ksm_ready = 1;
+}
+
+//
+// a fast 32-bit checksum of a page (FNV-1a over 64-bit words).
+//
+static uint32 ksm_checksum(const uint64 *page) {
+  uint64 h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < PGSIZE / sizeof(uint64); i++) h = (h ^ page[i]) * 0x100000001b3ULL;
+  return (uint32)(h ^ (h >> 32));
+}
+
+static int ksm_insert(uint32 checksum, int stable, uint64 pa, process *owner, uint64 va) {
+  if (g_free_node < 0) return -1;
+
+  int n = g_free_node;
+  g_free_node = g_nodes[n].next;
+  g_nodes[n].checksum = checksum;
+  g_nodes[n].stable = stable;
+  g_nodes[n].pa = pa;
+  g_nodes[n].owner = owner;
+  g_nodes[n].va = va;
+  g_nodes[n].next = g_buckets[checksum % KSM_BUCKETS];
+  g_buckets[checksum % KSM_BUCKETS] = n;
+  return n;
+}
+
+//
+// drop the unstable nodes at the end of a pass (their pages may have changed since),
+// and the stable frames no mapping shares anymore.
+//
+static void ksm_prune() {
+  for (int b = 0; b < KSM_BUCKETS; b++) {
+    int *link = &g_buckets[b];
+    while (*link >= 0) {
+      ksm_node *node = &g_nodes[*link];
+      int drop = !node->stable || page_ref((void *)node->pa) == 1;
+      if (!drop) {
+        link = &node->next;
+        continue;
+      }
+
+      if (node->stable) {
+        put_page((void *)node->pa);
+        g_pages_shared--;
+      }
+      int n = *link;
+      *link = node->next;
+      node->next = g_free_node;
+      g_free_node = n;
+    }
+  }
+}
+
+//
+// remap the user page at *pte to the stable frame "pa", and release its own frame.
+//
+static void ksm_merge(pte_t *pte, uint64 pa) {
+  uint64 old = PTE2PA(*pte);
+  get_page((void *)pa);
+  *pte = PA2PTE(pa) | ((PTE_FLAGS(*pte) & ~(PTE_W | PTE_D)) | PTE_COW);
+  put_page((void *)old);
+  g_pages_merged++;
+}
+
+//
+// look for an identical page for the user page at *pte, and merge with it if found.
+//
+static void ksm_scan_page(process *p, pte_t *pte, uint64 va) {
+  uint64 pa = PTE2PA(*pte);
+  uint32 checksum = ksm_checksum((uint64 *)pa);
+
+  for (int n = g_buckets[checksum % KSM_BUCKETS]; n >= 0; n = g_nodes[n].next) {
+    ksm_node *node = &g_nodes[n];
+    if (node->checksum != checksum || node->pa == pa) continue;
+
+    if (!node->stable) {
+      // the unstable page must still be mapped, writable and unchanged.
+      process *owner = node->owner;
+      if (owner->status == FREE || owner->status == ZOMBIE || proc_running_elsewhere(owner))
+        continue;
+      pte_t *opte = page_walk(owner->pagetable, node->va, 0);
+      if (opte == 0 || (*opte & PTE_V) == 0 || PTE2PA(*opte) != node->pa ||
+          (*opte & PTE_W) == 0 || page_ref((void *)node->pa) != 1)
+        continue;
+      if (memcmp((void *)node->pa, (void *)pa, PGSIZE) != 0) continue;
+
+      // promote it: the owner keeps the frame, now read-only, and so does the table.
+      *opte = (*opte & ~(PTE_W | PTE_D)) | PTE_COW;
+      get_page((void *)node->pa);
+      node->stable = 1;
+      node->owner = NULL;
+      g_pages_shared++;
+    } else if (memcmp((void *)node->pa, (void *)pa, PGSIZE) != 0) {
+      continue;
+    }
+
+    ksm_merge(pte, node->pa);
+    return;
+  }
+
+  ksm_insert(checksum, 0, pa, p, va);
+}
+
+typedef struct ksm_walk_t {
+  process *p;
+  int budget;
+} ksm_walk;
+
+static void ksm_scan_pte(pte_t *pte, uint64 va, void *arg) {
+  ksm_walk *w = (ksm_walk *)arg;
+  if (va < g_cursor_va || w->budget == 0) return;
+
+  // only private writable anonymous pages are candidates; code and already merged
+  // pages are not.
+  if ((*pte & PTE_W) && !(*pte & PTE_X) && page_ref((void *)PTE2PA(*pte)) == 1)
+    ksm_scan_page(w->p, pte, va);
+
+  g_cursor_va = va + PGSIZE;
+  w->budget--;
+}
+
+//
+// continue the pass over the pages of mergeable processes, for at most
+// KSM_PAGES_TO_SCAN pages.
+//
+void ksm_scan() {
+  if (!g_ksm_ready) ksm_init();
+
+  uint64 merged = g_pages_merged;
+  ksm_walk w = {NULL, KSM_PAGES_TO_SCAN};
+
+  // processes are listed by increasing pid, so the cursor survives processes exiting.
+  process *p = g_proc_list;
+  while (p && p->pid < g_cursor_pid) p = p->all_next;
+  for (; w.budget > 0; p = p->all_next) {
+    if (p == NULL) {
+      // a full pass is done.
+      g_cursor_pid = 0;
+      g_cursor_va = 0;
+      g_full_scans++;
+      ksm_prune();
+      break;
+    }
+    if (p->pid != g_cursor_pid) {
+      g_cursor_pid = p->pid;
+      g_cursor_va = 0;
+    }
+    // a process running on another hart is left for the next pass.
+    // threads are scanned with their leader, whose address space they share.
+    if (p->ksm_mergeable && p->status != ZOMBIE && p->leader == p &&
+        !proc_running_elsewhere(p)) {
+      w.p = p;
+      user_vm_walk(p->pagetable, ksm_scan_pte, &w);
+      // the walk stopped early: resume within this process next time.
+      if (w.budget == 0) break;
+    }
+    g_cursor_pid = p->pid + 1;
+    g_cursor_va = 0;
+  }
+
+  // merged mappings were write-protected.
+  flush_tlb();
+
+  if (g_pages_merged != merged)
+    sprint("ksm: %ld pages merged so far, %ld shared frames, %ld full scans.\n",
+           g_pages_merged, g_pages_shared, g_full_scans);
+}
@@ -0,0 +1,9 @@
+#ifndef _KSM_H_
+#define _KSM_H_
+
+#include "process.h"
+
+// scan up to KSM_PAGES_TO_SCAN mergeable pages, merging identical ones
+void ksm_scan();
+
+#endif
@@ -5,17 +5,22 @@
 #include "util/types.h"
 #include "kernel/riscv.h"
 #include "kernel/config.h"
+#include "kernel/sbi.h"
 #include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_bootargs.h"
+#include "spike_interface/spike_isa.h"
+#include "spike_interface/atomic.h"
 
 //
 // global variables are placed in the .data section.
 // stack0 is the privilege mode stack(s) of the proxy kernel on CPU(s)
 // allocates 4KB stack space for each processor (hart)
 //
-// NCPU is defined to be 1 in kernel/config.h, as we consider only one HART in basic
-// labs.
+// NCPU is defined in kernel/config.h. the stack of a hart is also used by s_start()
+// in S-mode, so M-mode traps are handled on another stack, mstack.
 //
 __attribute__((aligned(16))) char stack0[4096 * NCPU];
+__attribute__((aligned(16))) char mstack[4096 * NCPU];
 
 // sstart() is the supervisor state entry point defined in kernel/kernel.c
 extern void s_start();
@@ -27,8 +32,13 @@ extern uint64 htif;
 // g_mem_size is defined in spike_interface/spike_memory.c, size of the emulated memory
 extern uint64 g_mem_size;
 // struct riscv_regs is define in kernel/riscv.h, and g_itrframe is used to save
-// registers when interrupt hapens in M mode. added @lab1_2
-riscv_regs g_itrframe;
+// registers when interrupt hapens in M mode, one per hart. added @lab1_2
+riscv_regs g_itrframe[NCPU];
+
+// set by hart 0 when the machine-wide initialization (HTIF, DTS) is done.
+static volatile int g_mboot_done = 0;
+
+volatile int g_sstc = 0;
 
 //
 // get the information of HTIF (calling interface) and the emulated memory by
@@ -46,6 +56,24 @@ void init_dtb(uint64 dtb) {
   // defined in spike_interface/spike_memory.c, obtain information about emulated memory
   query_mem(dtb);
   sprint("(Emulated) memory size: %ld MB\n", g_mem_size >> 20);
+
+  // kernel command line, e.g., "sched=cfs" (cf. sched_init() in kernel/sched.c)
+  query_bootargs(dtb);
+  if (g_bootargs[0]) sprint("bootargs: %s\n", g_bootargs);
+
+  // the extensions of the harts, e.g., Sstc (cf. sstc_init())
+  query_isa(dtb);
+}
+
+//
+// enable the Sstc extension on this hart, if the DTS lists it and menvcfg.STCE sticks.
+// S-mode then takes its timer interrupts directly, without the M-mode bounce of
+// handle_timer() in kernel/machine/mtrap.c. returns non-zero if it is enabled.
+//
+static int sstc_init() {
+  if (!isa_has_ext("sstc")) return 0;
+  write_menvcfg(read_menvcfg() | MENVCFG_STCE);
+  return (read_menvcfg() & MENVCFG_STCE) != 0;
 }
 
 //
@@ -61,10 +89,13 @@ static void delegate_traps() {
   }
 
   // macros used in following two statements are defined in kernel/riscv.h
+  // illegal instructions go to S-mode, which loads the FP registers of a process on its
+  // first FP instruction (cf. kernel/fpu.c).
   uintptr_t interrupts = MIP_SSIP | MIP_STIP | MIP_SEIP;
   uintptr_t exceptions = (1U << CAUSE_MISALIGNED_FETCH) | (1U << CAUSE_FETCH_PAGE_FAULT) |
                          (1U << CAUSE_BREAKPOINT) | (1U << CAUSE_LOAD_PAGE_FAULT) |
-                         (1U << CAUSE_STORE_PAGE_FAULT) | (1U << CAUSE_USER_ECALL);
+                         (1U << CAUSE_STORE_PAGE_FAULT) | (1U << CAUSE_USER_ECALL) |
+                         (1U << CAUSE_ILLEGAL_INSTRUCTION);
 
   // writes 64-bit values (interrupts and exceptions) to 'mideleg' and 'medeleg' (two
   // priviledged registers of RV64G machine) respectively.
@@ -80,11 +111,20 @@ static void delegate_traps() {
 // enabling timer interrupt (irq) in Machine mode. added @lab1_3
 //
 void timerinit(uintptr_t hartid) {
+  // with Sstc, the timer irqs go to S-mode, and M-mode only takes the software irqs
+  // carrying inter-processor interrupts (cf. smp_send_ipi()).
+  if (g_sstc) {
+    write_stimecmp(*(uint64*)CLINT_MTIME + TIMER_INTERVAL);
+    write_csr(mie, read_csr(mie) | MIE_MSIE);
+    return;
+  }
+
   // fire timer irq after TIMER_INTERVAL from now.
   *(uint64*)CLINT_MTIMECMP(hartid) = *(uint64*)CLINT_MTIME + TIMER_INTERVAL;
 
-  // enable machine-mode timer irq in MIE (Machine Interrupt Enable) csr.
-  write_csr(mie, read_csr(mie) | MIE_MTIE);
+  // enable machine-mode timer irq in MIE (Machine Interrupt Enable) csr, and the
+  // software irq that carries inter-processor interrupts (cf. smp_send_ipi()).
+  write_csr(mie, read_csr(mie) | MIE_MTIE | MIE_MSIE);
 }
 
 //
@@ -94,15 +134,26 @@ void m_start(uintptr_t hartid, uintptr_t dtb) {
   // init the spike file interface (stdin,stdout,stderr)
   // functions with "spike_" prefix are all defined in codes under spike_interface/,
   // sprint is also defined in spike_interface/spike_utils.c
-  spike_file_init();
-  sprint("In m_start, hartid:%d\n", hartid);
-
-  // init HTIF (Host-Target InterFace) and memory by using the Device Table Blob (DTB)
-  // init_dtb() is defined above.
-  init_dtb(dtb);
+  // hart 0 does it for all harts, the others wait.
+  if (hartid == 0) {
+    spike_file_init();
+    sprint("In m_start, hartid:%d\n", hartid);
+
+    // init HTIF (Host-Target InterFace) and memory by using the Device Table Blob (DTB)
+    // init_dtb() is defined above.
+    init_dtb(dtb);
+    g_sstc = sstc_init();
+    if (g_sstc) sprint("Sstc is available, S-mode sets its own timer.\n");
+    mb();
+    g_mboot_done = 1;
+  } else {
+    while (!g_mboot_done)
+      ;
+    sprint("In m_start, hartid:%d\n", hartid);
+  }
 
   // save the address of trap frame for interrupt in M mode to "mscratch". added @lab1_2
-  write_csr(mscratch, &g_itrframe);
+  write_csr(mscratch, &g_itrframe[hartid]);
 
   // set previous privilege mode to S (Supervisor), and will enter S mode after 'mret'
   // write_csr is a macro defined in kernel/riscv.h
@@ -121,12 +172,19 @@ void m_start(uintptr_t hartid, uintptr_t dtb) {
   // delegate_traps() is defined above.
   delegate_traps();
 
+  // let supervisor mode read the cycle, time and instret counters.
+  write_csr(mcounteren, 0x7);
+
   // also enables interrupt handling in supervisor mode. added @lab1_3
   write_csr(sie, read_csr(sie) | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
   // init timing. added @lab1_3
+  if (hartid != 0 && g_sstc && !sstc_init()) panic("hart %d lacks Sstc.\n", hartid);
   timerinit(hartid);
 
+  // S-mode code finds the id of its hart in tp (cf. kernel/smp.h)
+  write_tp(hartid);
+
   // switch to supervisor mode (S mode) and jump to s_start(), i.e., set pc to mepc
   asm volatile("mret");
 }
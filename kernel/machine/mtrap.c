@@ -1,7 +1,10 @@
 #include "kernel/riscv.h"
 #include "kernel/process.h"
+#include "kernel/sbi.h"
 #include "spike_interface/spike_utils.h"
 
+extern riscv_regs g_itrframe[NCPU];
+
 static void handle_instruction_access_fault() { panic("Instruction access fault!"); }
 
 static void handle_load_access_fault() { panic("Load access fault!"); }
@@ -16,12 +19,49 @@ static void handle_misaligned_store() { panic("Misaligned AMO!"); }
 
 // added @lab1_3
 static void handle_timer() {
-  int cpuid = 0;
+  int cpuid = read_csr(mhartid);
+#if TIMER_TICKLESS
+  // S-mode sets the next timer itself (cf. SBI_SET_TIMER). it is off until then.
+  *(uint64*)CLINT_MTIMECMP(cpuid) = -1UL;
+#else
   // setup the timer fired at next time (TIMER_INTERVAL from now)
   *(uint64*)CLINT_MTIMECMP(cpuid) = *(uint64*)CLINT_MTIMECMP(cpuid) + TIMER_INTERVAL;
+#endif
+
+  // setup a soft interrupt in sip (S-mode Interrupt Pending) to be handled in S-mode.
+  // the flag tells it apart from an inter-processor interrupt (cf. handle_ipi()).
+  g_timer_pending[cpuid] = 1;
+  write_csr(sip, read_csr(sip) | SIP_SSIP);
+}
+
+//
+// another hart sent us an inter-processor interrupt. pass it on to S-mode as a soft
+// interrupt, which stays pending (and keeps wfi from sleeping) until S-mode takes it.
+//
+static void handle_ipi() {
+  *(uint32*)CLINT_MSIP(read_csr(mhartid)) = 0;
+  write_csr(sip, read_csr(sip) | SIP_SSIP);
+}
 
-  // setup a soft interrupt in sip (S-mode Interrupt Pending) to be handled in S-mode
-  write_csr(sip, SIP_SSIP);
+//
+// a service request (ecall) from the S-mode kernel, cf. kernel/sbi.h.
+//
+static void handle_sbi_call(riscv_regs *regs) {
+  switch (regs->a7) {
+    case SBI_SEND_IPI:
+      *(uint32*)CLINT_MSIP(regs->a0) = 1;
+      regs->a0 = 0;
+      break;
+    case SBI_SET_TIMER:
+      *(uint64*)CLINT_MTIMECMP(read_csr(mhartid)) = regs->a0;
+      regs->a0 = 0;
+      break;
+    default:
+      regs->a0 = -1;
+      break;
+  }
+  // return to the instruction after the ecall.
+  write_csr(mepc, read_csr(mepc) + 4);
 }
 
 //
@@ -33,6 +73,12 @@ void handle_mtrap() {
     case CAUSE_MTIMER:
       handle_timer();
       break;
+    case CAUSE_MSOFT:
+      handle_ipi();
+      break;
+    case CAUSE_SUPERVISOR_ECALL:
+      handle_sbi_call(&g_itrframe[read_csr(mhartid)]);
+      break;
     case CAUSE_FETCH_ACCESS:
       handle_instruction_access_fault();
       break;
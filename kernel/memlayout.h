@@ -12,9 +12,30 @@
 #define STACK_SIZE 4096
 
 // virtual address of stack top of user process
-#define USER_STACK_TOP 0x7ffff000
+#define USER_STACK_TOP_SV39 0x7ffff000
+// Sv48 puts the stack at the top of the 128TB user space.
+#define USER_STACK_TOP_SV48 0x7ffffffff000L
+#define USER_STACK_TOP g_user_stack_top
+
+// the user stack of a process may grow to this many pages (cf. handle_user_page_fault())
+#define USER_STACK_PAGES 20
+
+// the user stacks of threads (cf. do_clone() in kernel/process.c) lie below the room of
+// the main stack, one page each. an unmapped guard page separates each of them from
+// the stack above it.
+#define MAX_THREADS 64
+#define THREAD_STACK_TOP(slot) \
+  (USER_STACK_TOP - USER_STACK_PAGES * STACK_SIZE - PGSIZE - (slot) * 2 * PGSIZE)
 
 // start virtual address (4MB) of our simple heap. added @lab2_2
-#define USER_FREE_ADDRESS_START 0x00000000 + PGSIZE * 1024
+#define USER_FREE_ADDRESS_START_SV39 0x00000000 + PGSIZE * 1024
+// Sv48 starts the heap above the (direct mapped) kernel, leaving it all the room up to
+// the stack.
+#define USER_FREE_ADDRESS_START_SV48 0x100000000L
+#define USER_FREE_ADDRESS_START g_user_free_start
+
+// the user layout of the paging mode in use, set up by vm_set_mode() (kernel/vmm.c)
+extern uint64 g_user_stack_top;
+extern uint64 g_user_free_start;
 
 #endif
@@ -22,12 +22,27 @@ typedef struct node {
 // g_free_mem_list is the head of the list of free physical memory pages
 static list_node g_free_mem_list;
 
+// reference counts of physical pages, indexed by page frame number (relative to
+// DRAM_BASE). a page is referenced once when allocated, and additional references are
+// taken by mappings that share it (e.g., pages merged by kernel/ksm.c).
+static uint16 g_page_refs[PKE_MAX_ALLOWABLE_RAM / PGSIZE];
+#define PAGE_REF(pa) (g_page_refs[((uint64)(pa) - DRAM_BASE) >> PGSHIFT])
+
+// free pages known to be filled with zeros, but for the list link in their first word.
+// the idle loop fills it from g_free_mem_list (cf. pmm_zero_pages()), and
+// alloc_zeroed_page() takes from it.
+static list_node g_zero_mem_list;
+static uint64 g_zero_pages = 0;
+
+// number of pages in g_free_mem_list and g_zero_mem_list
+static uint64 g_free_pages = 0;
+
 //
 // actually creates the freepage list. each page occupies 4KB (PGSIZE), i.e., small page.
 // PGSIZE is defined in kernel/riscv.h, ROUNDUP is defined in util/functions.h.
 //
 static void create_freepage_list(uint64 start, uint64 end) {
-  g_free_mem_list.next = 0;
+  g_free_mem_list.next = g_zero_mem_list.next = 0;
   for (uint64 p = ROUNDUP(start, PGSIZE); p + PGSIZE < end; p += PGSIZE)
     free_page( (void *)p );
 }
@@ -39,23 +54,99 @@ void free_page(void *pa) {
   if (((uint64)pa % PGSIZE) != 0 || (uint64)pa < free_mem_start_addr || (uint64)pa >= free_mem_end_addr)
     panic("free_page 0x%lx \n", pa);
 
+  PAGE_REF(pa) = 0;
+
   // insert a physical page to g_free_mem_list
   list_node *n = (list_node *)pa;
   n->next = g_free_mem_list.next;
   g_free_mem_list.next = n;
+  g_free_pages++;
 }
 
 //
 // takes the first free page from g_free_mem_list, and returns (allocates) it.
-// Allocates only ONE page!
+// Allocates only ONE page! the pre-zeroed pages are only used when no other is left.
 //
 void *alloc_page(void) {
-  list_node *n = g_free_mem_list.next;
-  if (n) g_free_mem_list.next = n->next;
+  list_node *head = g_free_mem_list.next ? &g_free_mem_list : &g_zero_mem_list;
+  list_node *n = head->next;
+  if (n) {
+    head->next = n->next;
+    PAGE_REF(n) = 1;
+    g_free_pages--;
+    if (head == &g_zero_mem_list) g_zero_pages--;
+  }
 
   return (void *)n;
 }
 
+//
+// allocates a page filled with zeros, pre-zeroed by the idle loop if one is available.
+//
+void *alloc_zeroed_page(void) {
+  list_node *n = g_zero_mem_list.next;
+  if (n == NULL) {
+    void *pa = alloc_page();
+    if (pa) memset(pa, 0, PGSIZE);
+    return pa;
+  }
+
+  g_zero_mem_list.next = n->next;
+  n->next = NULL;
+  PAGE_REF(n) = 1;
+  g_zero_pages--;
+  g_free_pages--;
+  return (void *)n;
+}
+
+//
+// zero up to n free pages ahead of time, as long as fewer than PMM_ZERO_POOL_PAGES are
+// pre-zeroed. returns the number of pages zeroed.
+//
+int pmm_zero_pages(int n) {
+  int done = 0;
+  while (done < n && g_zero_pages < PMM_ZERO_POOL_PAGES && g_free_mem_list.next) {
+    list_node *p = g_free_mem_list.next;
+    g_free_mem_list.next = p->next;
+    memset(p, 0, PGSIZE);
+    p->next = g_zero_mem_list.next;
+    g_zero_mem_list.next = p;
+    g_zero_pages++;
+    done++;
+  }
+  return done;
+}
+
+//
+// returns the number of free physical pages.
+//
+uint64 nr_free_pages(void) {
+  return g_free_pages;
+}
+
+//
+// take an extra reference to the allocated page at *pa.
+//
+void get_page(void *pa) {
+  kassert(PAGE_REF(pa) > 0);
+  PAGE_REF(pa)++;
+}
+
+//
+// drop a reference to the page at *pa. the page is freed when no reference remains.
+//
+void put_page(void *pa) {
+  kassert(PAGE_REF(pa) > 0);
+  if (--PAGE_REF(pa) == 0) free_page(pa);
+}
+
+//
+// returns the number of references held on the page at *pa.
+//
+int page_ref(void *pa) {
+  return PAGE_REF(pa);
+}
+
 //
 // pmm_init() establishes the list of free physical pages according to available
 // physical memory space.
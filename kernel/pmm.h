@@ -1,11 +1,25 @@
 #ifndef _PMM_H_
 #define _PMM_H_
 
+#include "util/types.h"
+
 // Initialize phisical memeory manager
 void pmm_init();
 // Allocate a free phisical page
 void* alloc_page();
+// Allocate a free phisical page filled with zeros
+void* alloc_zeroed_page();
+// Zero up to n free pages ahead of time, returns the number zeroed
+int pmm_zero_pages(int n);
 // Free an allocated page
 void free_page(void* pa);
+// Number of free phisical pages
+uint64 nr_free_pages();
+// Take an extra reference to an allocated page
+void get_page(void* pa);
+// Drop a reference to an allocated page, freeing it when the last one goes away
+void put_page(void* pa);
+// Number of references held on an allocated page
+int page_ref(void* pa);
 
 #endif
\ No newline at end of file
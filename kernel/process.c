@@ -16,6 +16,10 @@
 #include "pmm.h"
 #include "memlayout.h"
 #include "sched.h"
+#include "zram.h"
+#include "kmem.h"
+#include "fpu.h"
+#include "futex.h"
 #include "spike_interface/spike_utils.h"
 
 //Two functions defined in kernel/usertrap.S
@@ -26,38 +30,60 @@ extern void return_to_user(trapframe *, uint64 satp);
 // of S-mode trap vector).
 extern char trap_sec_start[];
 
-// process pool. added @lab3_1
-process procs[NPROC];
-
-// current points to the currently running user-mode application.
-process* current = NULL;
+// process pool: the process structures come from an object cache. a process is found
+// by its pid through g_pid_hash, and all processes are linked, oldest first, in
+// g_proc_list. added @lab3_1
+static kmem_cache g_proc_cache = KMEM_CACHE_INIT( "process", process );
+static process* g_pid_hash[PID_HASH_SIZE];
+process* g_proc_list;
+static process* g_proc_list_tail;
+static int64 g_next_pid = 0;
+// number of processes that have not exited
+int g_nr_live = 0;
+
+// the skeletons of reaped processes, kept by each hart for alloc_process() to reuse: a
+// page directory that maps only the trapframe and the trap vector, with its trapframe,
+// kernel stack and mapped_info page.
+typedef struct proc_skel_t {
+  pagetable_t pagetable;
+  int nr_pt_pages;        // page-table pages left in pagetable
+  trapframe *trapframe;
+  uint64 kstack;
+  mapped_region *mapped_info;
+} proc_skel;
+static proc_skel g_skel_cache[NCPU][PROC_SKEL_CACHE_SIZE];
+static int g_nr_skels[NCPU];
+
+// current points to the currently running user-mode application, on each hart.
+process* current_percpu[NCPU];
 
 // points to the first free page in our simple heap. added @lab2_2
-uint64 g_ufree_page = USER_FREE_ADDRESS_START;
+// set up in init_proc_pool(), as the heap start depends on the paging mode.
+uint64 g_ufree_page;
 
 //
-// switch to a user-mode process
+// return to user mode, in the process proc. this is the costly part of running a
+// process, done only on the way out of the kernel: switching between processes inside
+// the kernel is done by schedule(), which only swaps kernel contexts.
 //
 void switch_to(process* proc) {
   assert(proc);
   current = proc;
 
-  // write the smode_trap_vector (64-bit func. address) defined in kernel/strap_vector.S
-  // to the stvec privilege register, such that trap handler pointed by smode_trap_vector
-  // will be triggered when an interrupt occurs in S mode.
-  write_csr(stvec, (uint64)smode_trap_vector);
-
   // set up trapframe values (in process structure) that smode_trap_vector will need when
   // the process next re-enters the kernel.
   proc->trapframe->kernel_sp = proc->kstack;      // process's kernel stack
   proc->trapframe->kernel_satp = read_csr(satp);  // kernel page table
   proc->trapframe->kernel_trap = (uint64)smode_trap_handler;
+  proc->trapframe->kernel_hartid = cpuid();                 // for tp
 
   // SSTATUS_SPP and SSTATUS_SPIE are defined in kernel/riscv.h
   // set S Previous Privilege mode (the SSTATUS_SPP bit in sstatus register) to User mode.
   unsigned long x = read_csr(sstatus);
   x &= ~SSTATUS_SPP;  // clear SPP to 0 for user mode
   x |= SSTATUS_SPIE;  // enable interrupts in user mode
+  // the FP registers are usable only if they hold the state of proc (cf. kernel/fpu.c).
+  x = (x & ~SSTATUS_FS) | fpu_user_fs(proc);
 
   // write x back to 'sstatus' register to enable interrupts, and sret destination mode.
   write_csr(sstatus, x);
@@ -68,84 +94,281 @@ void switch_to(process* proc) {
   // make user page table. macro MAKE_SATP is defined in kernel/riscv.h. added @lab2_1
   uint64 user_satp = MAKE_SATP(proc->pagetable);
 
+  // set the timer of the hart for the next event to handle, in tickless mode.
+  program_timer();
+
+  // leave the kernel (cf. kernel/smp.h). from here on, only proc's own trapframe and
+  // the per-hart CSRs are touched.
+  smp_leave_kernel();
+  kernel_unlock();
+
+  // write the smode_trap_vector (64-bit func. address) defined in kernel/strap_vector.S
+  // to the stvec privilege register, such that trap handler pointed by smode_trap_vector
+  // will be triggered when an interrupt occurs in S mode. until here, traps of the
+  // kernel went to kernel_trap_vector (cf. smode_trap_handler()).
+  write_csr(stvec, (uint64)smode_trap_vector);
+
   // return_to_user() is defined in kernel/strap_vector.S. switch to user mode with sret.
   // note, return_to_user takes two parameters @ and after lab2_1.
   return_to_user(proc->trapframe, user_satp);
 }
 
 //
-// initialize process pool (the procs[] array). added @lab3_1
+// a new process starts here, in the kernel context set up by alloc_process(), when
+// schedule() first switches to it (holding the kernel lock). it goes to user mode.
+//
+static void forkret() {
+  // a process killed before it ever ran exits right away.
+  if( current->killed ) do_exit( -1 );
+  switch_to( current );
+}
+
+//
+// initialize process pool (the process structure cache, and the pid hash). added @lab3_1
 //
 void init_proc_pool() {
-  memset( procs, 0, sizeof(process)*NPROC );
+  memset( g_pid_hash, 0, sizeof(g_pid_hash) );
+  g_proc_list = g_proc_list_tail = NULL;
+  g_ufree_page = USER_FREE_ADDRESS_START;
+}
 
-  for (int i = 0; i < NPROC; ++i) {
-    procs[i].status = FREE;
-    procs[i].pid = i;
-  }
+//
+// look up the process with the given pid, NULL if there is none (anymore).
+//
+process* find_process( int64 pid ) {
+  if( pid < 0 ) return NULL;
+  for( process *p = g_pid_hash[pid % PID_HASH_SIZE]; p; p = p->pid_next )
+    if( p->pid == pid ) return p;
+  return NULL;
 }
 
 //
-// allocate an empty process, init its vm space. returns the pointer to
-// process strcuture. added @lab3_1
+// make child a child of parent, at the head of its children list.
 //
-process* alloc_process() {
-  // locate the first usable process structure
-  int i;
+static void add_child( process* parent, process* child ) {
+  child->parent = parent;
+  child->sibling_prev = NULL;
+  child->sibling_next = parent->first_child;
+  if( parent->first_child ) parent->first_child->sibling_prev = child;
+  parent->first_child = child;
+}
+
+//
+// remove child from the children list of its parent.
+//
+static void remove_child( process* child ) {
+  process *parent = child->parent;
+  if( child->sibling_prev ) child->sibling_prev->sibling_next = child->sibling_next;
+  else parent->first_child = child->sibling_next;
+  if( child->sibling_next ) child->sibling_next->sibling_prev = child->sibling_prev;
+  child->parent = child->sibling_next = child->sibling_prev = NULL;
+}
 
-  for( i=0; i<NPROC; i++ )
-    if( procs[i].status == FREE ) break;
+//
+// set up a process structure around the trapframe tf and the kernel stack (top) kstack,
+// with no address space. it gets a new pid, and the default scheduling attributes.
+// returns NULL if out of memory.
+//
+static process* new_task( trapframe* tf, uint64 kstack ) {
+  // take a process structure from the cache
+  process *p = kmem_cache_alloc( &g_proc_cache );
+  if( p == NULL ) return NULL;
+
+  p->trapframe = tf;  //trapframe, used to save context
+  p->kstack = kstack;   //user kernel stack top
+  // the first switch to the process enters forkret(), on its empty kernel stack.
+  p->ctx.ra = (uint64)forkret;
+  p->ctx.sp = p->kstack;
+  p->fp_cpu = -1;
+  p->leader = p;
+
+  p->tick_count = 0;
+  p->cpu = -1;
+  p->cpu_mask = (1L << NCPU) - 1;
+  p->mlfq_level = p->mlfq_slice = 0;
+  p->mlfq_pin = -1;
+  p->sum_exec = p->vruntime = 0;
+  p->nice = 0;
+  p->cfs_weight = NICE_0_WEIGHT;
+  p->dl_runtime = p->dl_jobs = p->dl_misses = p->dl_overruns = 0;
+  p->killed = 0;
+  // a new pid, which is never reused, and the process is known by it from now on.
+  p->status = FREE;
+  p->pid = g_next_pid++;
+  p->pid_next = g_pid_hash[p->pid % PID_HASH_SIZE];
+  g_pid_hash[p->pid % PID_HASH_SIZE] = p;
+  p->all_prev = g_proc_list_tail;
+  if (g_proc_list_tail) g_proc_list_tail->all_next = p; else g_proc_list = p;
+  g_proc_list_tail = p;
+  g_nr_live++;
+  return p;
+}
 
-  if( i>=NPROC ){
-    panic( "cannot find any free process structure.\n" );
-    return 0;
+//
+// allocate a process structure, with a new trapframe and kernel stack. returns NULL if
+// out of memory.
+//
+static process* alloc_task() {
+  trapframe *tf = (trapframe *)alloc_zeroed_page();
+  void *kstack = alloc_page();
+  process *p = NULL;
+  if( tf && kstack ) p = new_task( tf, (uint64)kstack + PGSIZE );
+  if( p == NULL ){
+    if( tf ) free_page( tf );
+    if( kstack ) free_page( kstack );
   }
+  return p;
+}
 
-  // init proc[i]'s vm space
-  procs[i].trapframe = (trapframe *)alloc_page();  //trapframe, used to save context
-  memset(procs[i].trapframe, 0, sizeof(trapframe));
+//
+// complete the address space of p, whose page directory maps the trapframe and the trap
+// vector already: map a user stack, and record the three regions in mapped_info. returns
+// -1 if out of memory.
+//
+static int init_vm( process* p ) {
+  void *user_stack = alloc_page();       //phisical address of user stack bottom
+  if( user_stack == NULL ) return -1;
 
-  // page directory
-  procs[i].pagetable = (pagetable_t)alloc_page();
-  memset((void *)procs[i].pagetable, 0, PGSIZE);
+  // map user stack in userspace
+  int nr_pt = map_pages((pagetable_t)p->pagetable, USER_STACK_TOP - PGSIZE, PGSIZE,
+    (uint64)user_stack, prot_to_type(PROT_WRITE | PROT_READ, 1));
+  if( nr_pt < 0 ){
+    free_page( user_stack );
+    return -1;
+  }
+
+  // charge the process for its kernel objects and stack.
+  mm_charge(p, MM_KOBJ, 3);
+  mm_charge(p, MM_RSS, 1);
+  mm_charge(p, MM_PAGETABLE, nr_pt);
+  p->mapped_info[0].va = USER_STACK_TOP - PGSIZE;
+  p->mapped_info[0].npages = 1;
+  p->mapped_info[0].seg_type = STACK_SEGMENT;
+
+  p->mapped_info[1].va = (uint64)p->trapframe;
+  p->mapped_info[1].npages = 1;
+  p->mapped_info[1].seg_type = CONTEXT_SEGMENT;
+
+  p->mapped_info[2].va = (uint64)trap_sec_start;
+  p->mapped_info[2].npages = 1;
+  p->mapped_info[2].seg_type = SYSTEM_SEGMENT;
+  p->total_mapped_region = 3;
+  return 0;
+}
 
-  procs[i].kstack = (uint64)alloc_page() + PGSIZE;   //user kernel stack top
-  uint64 user_stack = (uint64)alloc_page();       //phisical address of user stack bottom
-  procs[i].trapframe->regs.sp = USER_STACK_TOP;  //virtual address of user stack top
+//
+// build an empty address space for p: a new page directory with the user stack, the
+// trapframe and the trap vector mapped, and a new mapped_info. the memory charged to p
+// starts over. returns -1, with nothing allocated, if out of memory.
+//
+static int alloc_vm( process* p ) {
+  // page directory
+  p->pagetable = (pagetable_t)alloc_zeroed_page();
 
   // allocates a page to record memory regions (segments)
-  procs[i].mapped_info = (mapped_region*)alloc_page();
-  memset( procs[i].mapped_info, 0, PGSIZE );
+  p->mapped_info = (mapped_region*)alloc_zeroed_page();
+
+  p->mm_rss = p->mm_pt_pages = p->mm_kobj_pages = 0;
+  if( p->pagetable && p->mapped_info ){
+    // map trapframe in user space (direct mapping as in kernel space).
+    int nr_tf = map_pages((pagetable_t)p->pagetable, (uint64)p->trapframe, PGSIZE,
+      (uint64)p->trapframe, prot_to_type(PROT_WRITE | PROT_READ, 0));
+
+    // map S-mode trap vector section in user space (direct mapping as in kernel space)
+    // we assume that the size of usertrap.S is smaller than a page.
+    int nr_tv = nr_tf < 0 ? -1 : map_pages((pagetable_t)p->pagetable,
+      (uint64)trap_sec_start, PGSIZE, (uint64)trap_sec_start,
+      prot_to_type(PROT_READ | PROT_EXEC, 0));
+
+    if( nr_tv >= 0 ){
+      mm_charge(p, MM_PAGETABLE, 1 + nr_tf + nr_tv);
+      if( init_vm( p ) == 0 ) return 0;
+    }
+  }
+
+  // out of memory. the trapframe and trap vector are no user pages, and stay.
+  if( p->pagetable ) user_vm_free( p->pagetable );
+  if( p->mapped_info ) free_page( p->mapped_info );
+  p->pagetable = NULL;
+  p->mapped_info = NULL;
+  p->mm_rss = p->mm_pt_pages = p->mm_kobj_pages = 0;
+  return -1;
+}
+
+//
+// keep the page directory, trapframe, kernel stack and mapped_info of the reaped process
+// p in the cache of this hart, with the user pages dropped. returns 0 if the cache is
+// full.
+//
+static int skel_put( process* p ) {
+  int id = cpuid();
+  if( g_nr_skels[id] == PROC_SKEL_CACHE_SIZE ) return 0;
+
+  proc_skel *s = &g_skel_cache[id][g_nr_skels[id]++];
+  s->nr_pt_pages = user_vm_clear( p->pagetable );
+  // the elf loader takes the first empty entry of mapped_info (cf. kernel/elf.c).
+  memset( p->mapped_info, 0, p->total_mapped_region * sizeof(mapped_region) );
+  s->pagetable = p->pagetable;
+  s->trapframe = p->trapframe;
+  s->kstack = p->kstack;
+  s->mapped_info = p->mapped_info;
+  return 1;
+}
+
+//
+// allocate a process from a skeleton in the cache of this hart. its page directory maps
+// its trapframe and the trap vector already, the rest of its address space is left to
+// init_vm(). returns NULL if the cache is empty, or out of memory.
+//
+static process* skel_get() {
+  int id = cpuid();
+  if( g_nr_skels[id] == 0 ) return NULL;
+
+  proc_skel *s = &g_skel_cache[id][g_nr_skels[id] - 1];
+  memset( s->trapframe, 0, sizeof(trapframe) );
+  process *p = new_task( s->trapframe, s->kstack );
+  if( p == NULL ) return NULL;
+  g_nr_skels[id]--;
+  p->pagetable = s->pagetable;
+  p->mapped_info = s->mapped_info;
+  mm_charge( p, MM_PAGETABLE, s->nr_pt_pages );
+  return p;
+}
+
+//
+// give back a process that never ran, with whatever it has allocated.
+//
+static void discard_process( process* p ) {
+  free_process( p );
+  release_process( p );
+}
+
+//
+// allocate an empty process, init its vm space. returns the pointer to
+// process strcuture, or NULL if out of memory. added @lab3_1
+//
+process* alloc_process() {
+  // the skeleton of a reaped process saves building the address space from scratch.
+  process *p = skel_get();
+  if( p != NULL ){
+    if( init_vm( p ) < 0 ){
+      discard_process( p );
+      return NULL;
+    }
+  } else {
+    p = alloc_task();
+    if( p == NULL ) return NULL;
+    if( alloc_vm( p ) < 0 ){
+      discard_process( p );
+      return NULL;
+    }
+  }
+  p->mm_soft_limit = PROC_MEM_SOFT_LIMIT;
+  p->mm_hard_limit = PROC_MEM_HARD_LIMIT;
+  p->trapframe->regs.sp = USER_STACK_TOP;  //virtual address of user stack top
 
-  // map user stack in userspace
-  user_vm_map((pagetable_t)procs[i].pagetable, USER_STACK_TOP - PGSIZE, PGSIZE,
-    user_stack, prot_to_type(PROT_WRITE | PROT_READ, 1));
-  procs[i].mapped_info[0].va = USER_STACK_TOP - PGSIZE;
-  procs[i].mapped_info[0].npages = 1;
-  procs[i].mapped_info[0].seg_type = STACK_SEGMENT;
-
-  // map trapframe in user space (direct mapping as in kernel space).
-  user_vm_map((pagetable_t)procs[i].pagetable, (uint64)procs[i].trapframe, PGSIZE,
-    (uint64)procs[i].trapframe, prot_to_type(PROT_WRITE | PROT_READ, 0));
-  procs[i].mapped_info[1].va = (uint64)procs[i].trapframe;
-  procs[i].mapped_info[1].npages = 1;
-  procs[i].mapped_info[1].seg_type = CONTEXT_SEGMENT;
-
-  // map S-mode trap vector section in user space (direct mapping as in kernel space)
-  // we assume that the size of usertrap.S is smaller than a page.
-  user_vm_map((pagetable_t)procs[i].pagetable, (uint64)trap_sec_start, PGSIZE,
-    (uint64)trap_sec_start, prot_to_type(PROT_READ | PROT_EXEC, 0));
-  procs[i].mapped_info[2].va = (uint64)trap_sec_start;
-  procs[i].mapped_info[2].npages = 1;
-  procs[i].mapped_info[2].seg_type = SYSTEM_SEGMENT;
-
-  sprint("in alloc_proc. user frame 0x%lx, user stack 0x%lx, user kstack 0x%lx \n",
-    procs[i].trapframe, procs[i].trapframe->regs.sp, procs[i].kstack);
-
-  procs[i].total_mapped_region = 3;
-  procs[i].waiting = NULL;
   // return after initialization.
-  return &procs[i];
+  return p;
 }
 
 //
@@ -154,13 +377,137 @@ process* alloc_process() {
 int free_process( process* proc ) {
   // we set the status to ZOMBIE, but cannot destruct its vm space immediately.
   // since proc can be current process, and its user kernel stack is currently in use!
-  // but for proxy kernel, it (memory leaking) may NOT be a really serious issue,
-  // as it is different from regular OS, which needs to run 7x24.
+  // the memory is reclaimed later by an idle hart (cf. reap_process()).
   proc->status = ZOMBIE;
+  g_nr_live--;
 
   return 0;
 }
 
+//
+// release the zombie process proc for good, once its exit has been collected by its
+// parent through wait(), or right away if it has no parent. its pid is no longer valid
+// after this.
+//
+void release_process( process* proc ) {
+  assert( proc->status == ZOMBIE );
+  reap_process( proc );
+
+  process **pp = &g_pid_hash[proc->pid % PID_HASH_SIZE];
+  while( *pp != proc ) pp = &(*pp)->pid_next;
+  *pp = proc->pid_next;
+
+  if( proc->all_prev ) proc->all_prev->all_next = proc->all_next;
+  else g_proc_list = proc->all_next;
+  if( proc->all_next ) proc->all_next->all_prev = proc->all_prev;
+  else g_proc_list_tail = proc->all_prev;
+
+  if( proc->parent ) remove_child( proc );
+  proc->status = FREE;
+  kmem_cache_free( &g_proc_cache, proc );
+}
+
+//
+// reclaim the memory of the zombie thread t: its trapframe, kernel stack and user stack,
+// which are unmapped from the address space of its leader.
+//
+static int reap_thread( process* t ) {
+  process *leader = t->leader;
+  pagetable_t pt = t->pagetable;
+
+  uint64 stack = lookup_pa( pt, THREAD_STACK_TOP(t->thread_slot) - PGSIZE );
+  user_vm_unmap( pt, (uint64)t->trapframe, PGSIZE, 0 );
+  mm_uncharge( t, MM_RSS, user_vm_unmap( pt, THREAD_STACK_TOP(t->thread_slot) - PGSIZE, PGSIZE, 0 ) );
+  mm_uncharge( t, MM_KOBJ, 2 );
+  // the other threads may reach the pages through their TLB until the shootdown.
+  tlb_shootdown( leader );
+  if( stack ) put_page( (void *)stack );
+  free_page( t->trapframe );
+  free_page( (void *)(t->kstack - PGSIZE) );
+
+  process **pp = &leader->thread_next;
+  while( *pp != t ) pp = &(*pp)->thread_next;
+  *pp = t->thread_next;
+  leader->nr_threads--;
+  leader->thread_slots &= ~(1UL << t->thread_slot);
+
+  t->leader = t;
+  t->thread_next = NULL;
+  t->pagetable = NULL;
+  t->trapframe = NULL;
+  t->kstack = 0;
+  t->mapped_info = NULL;
+  t->total_mapped_region = 0;
+  return 1;
+}
+
+//
+// reclaim the memory of the zombie process proc, whose kernel stack is no longer in use
+// (cf. do_exit()). the process structure stays a ZOMBIE. returns 0 if there was nothing
+// left to reclaim.
+//
+int reap_process( process* proc ) {
+  if( proc->status != ZOMBIE || proc->kstack == 0 ) return 0;
+
+  if( proc->leader != proc ) return reap_thread( proc );
+  // the address space goes with the leader, after its threads (which exited before it).
+  while( proc->thread_next ) reap_thread( proc->thread_next );
+
+  // a vfork child that exited without exec never had an address space of its own. the
+  // others leave the skeleton of theirs for the next alloc_process(), if there is room.
+  if( proc->pagetable == NULL || !skel_put( proc ) ){
+    if( proc->pagetable ){
+      user_vm_free( proc->pagetable );
+      free_page( proc->mapped_info );
+    }
+    free_page( proc->trapframe );
+    free_page( (void *)(proc->kstack - PGSIZE) );
+  }
+  proc->pagetable = NULL;
+  proc->trapframe = NULL;
+  proc->kstack = 0;
+  proc->mapped_info = NULL;
+  proc->total_mapped_region = 0;
+  proc->mm_rss = proc->mm_pt_pages = proc->mm_kobj_pages = 0;
+  return 1;
+}
+
+//
+// the scheduling attributes a new process inherits from its parent.
+//
+static void inherit_sched( process* child, process* parent ) {
+  // a pinned priority is inherited, otherwise the child starts at the top level.
+  child->mlfq_pin = parent->mlfq_pin;
+  if (child->mlfq_pin >= 0) child->mlfq_level = child->mlfq_pin;
+  child->cpu_mask = parent->cpu_mask;
+  child->vruntime = parent->vruntime;
+  child->nice = parent->nice;
+  child->cfs_weight = parent->cfs_weight;
+}
+
+//
+// give child a private copy of the page of parent at va, charged to child. returns -1 if
+// memory runs out, or the copy takes child over its hard limit.
+//
+static int fork_copy_page( process* child, process* parent, uint64 va ) {
+  uint64 pa = lookup_pa( parent->pagetable, va );
+  if( pa == 0 || mm_try_charge( child, MM_RSS, 1 ) < 0 ) return -1;
+  void *child_pa = alloc_page();
+  int nr_pt = -1;
+  if( child_pa != NULL ){
+    memcpy( child_pa, (void *)pa, PGSIZE );
+    nr_pt = map_pages( child->pagetable, va, PGSIZE, (uint64)child_pa,
+      prot_to_type( PROT_WRITE | PROT_READ, 1 ) );
+  }
+  if( nr_pt < 0 ){
+    if( child_pa ) free_page( child_pa );
+    mm_uncharge( child, MM_RSS, 1 );
+    return -1;
+  }
+  mm_charge( child, MM_PAGETABLE, nr_pt );
+  return 0;
+}
+
 //
 // implements fork syscal in kernel. added @lab3_1
 // basic idea here is to first allocate an empty process (child), then duplicate the
@@ -171,8 +518,18 @@ int free_process( process* proc ) {
 int do_fork( process* parent)
 {
   sprint( "will fork a child from parent %d.\n", parent->pid );
+  // a thread runs on a stack that is not recorded in mapped_info.
+  if( parent->leader != parent ){
+    sprint( "fork: process %d is a thread, and cannot fork.\n", parent->pid );
+    return -1;
+  }
   process* child = alloc_process();
+  if( child == NULL ) return -1;
+  // the copies of the data segments count against the limits the child inherits.
+  child->mm_soft_limit = parent->mm_soft_limit;
+  child->mm_hard_limit = parent->mm_hard_limit;
   uint64 pa;
+  int nr_pt;
   for( int i=0; i<parent->total_mapped_region; i++ ){
     // browse parent's vm space, and copy its trapframe and data segments,
     // map its code segment.
@@ -195,7 +552,15 @@ int do_fork( process* parent)
         // segment of parent process.
         // DO NOT COPY THE PHYSICAL PAGES, JUST MAP THEM.
         pa = lookup_pa(parent->pagetable, parent->mapped_info[i].va);
-        user_vm_map(child->pagetable, parent->mapped_info[i].va, PGSIZE, pa, prot_to_type(PROT_READ | PROT_EXEC, 1));
+        nr_pt = pa == 0 ? -1 : map_pages(child->pagetable, parent->mapped_info[i].va,
+          PGSIZE, pa, prot_to_type(PROT_READ | PROT_EXEC, 1));
+        if( nr_pt < 0 ){
+          discard_process( child );
+          return -1;
+        }
+        mm_charge(child, MM_PAGETABLE, nr_pt);
+        mm_charge(child, MM_RSS, 1);
+        get_page((void *)pa);
         sprint("do_fork map code segment at pa:%lx of parent to child at va:%lx.\n", pa, parent->mapped_info[i].va);
         // after mapping, register the vm region (do not delete codes below!)
         child->mapped_info[child->total_mapped_region].va = parent->mapped_info[i].va;
@@ -205,10 +570,11 @@ int do_fork( process* parent)
         child->total_mapped_region++;
         break;
       case DATA_SEGMENT:
-        uint64 pa = lookup_pa(parent->pagetable, parent->mapped_info[i].va);
-        void *child_pa = alloc_page();
-        memcpy(child_pa, (void *)pa, PGSIZE);
-        user_vm_map(child->pagetable, parent->mapped_info[i].va, PGSIZE, (uint64)child_pa, prot_to_type(PROT_WRITE | PROT_READ, 1));
+        if( fork_copy_page( child, parent, parent->mapped_info[i].va ) < 0 ){
+          sprint( "fork: no memory left for the data of process %d.\n", parent->pid );
+          discard_process( child );
+          return -1;
+        }
         child->mapped_info[child->total_mapped_region].va = parent->mapped_info[i].va;
         child->mapped_info[child->total_mapped_region].npages = parent->mapped_info[i].npages;
         child->mapped_info[child->total_mapped_region].seg_type = DATA_SEGMENT;
@@ -217,10 +583,373 @@ int do_fork( process* parent)
     }
   }
 
+  // the child starts with the FP registers of the parent, saved if they are loaded.
+  fpu_flush( parent );
+  child->fp = parent->fp;
+
   child->status = READY;
   child->trapframe->regs.a0 = 0;
-  child->parent = parent;
+  add_child( parent, child );
+  child->ksm_mergeable = parent->ksm_mergeable;
+  inherit_sched( child, parent );
+  insert_to_ready_queue( child );
+
+  return child->pid;
+}
+
+//
+// the vfork child p gives the address space it borrowed back to its parent, which waits
+// for it in do_vfork().
+//
+static void vfork_done( process* p ) {
+  process *parent = p->vfork_parent;
+  user_vm_unmap( parent->pagetable, (uint64)p->trapframe, PGSIZE, 0 );
+  p->vfork_parent = NULL;
+  p->leader = p;
+  parent->vfork_child = NULL;
+  wake_up_all( &parent->child_wq );
+}
+
+//
+// replace the image of process p by the elf at "path" on the host. a new address space
+// is built and loaded, and then the old one is freed, or given back to the parent of a
+// vfork child. p keeps its pid, children, timers and scheduling state. returns -1, with
+// the old image intact, if the elf cannot be loaded, memory runs out, or p has threads,
+// which would lose their address space.
+//
+int do_exec( process* p, const char* path )
+{
+  process *lender = p->vfork_parent;
+  if( !lender && (p->leader != p || p->nr_threads) ) return -1;
+
+  pagetable_t old_pagetable = p->pagetable;
+  mapped_region *old_info = p->mapped_info;
+  int old_regions = p->total_mapped_region;
+  uint64 old_rss = p->mm_rss, old_pt_pages = p->mm_pt_pages, old_kobj = p->mm_kobj_pages;
+  uint64 old_epc = p->trapframe->epc;
+
+  // the new address space is charged to p, even if it borrows that of its parent now.
+  p->leader = p;
+  if( alloc_vm( p ) < 0 || load_elf_from_host( p, path ) != EL_OK ){
+    // the trapframe and trap vector are not user pages, and stay mapped in the old one.
+    if( p->pagetable ){
+      user_vm_free( p->pagetable );
+      free_page( p->mapped_info );
+    }
+    p->pagetable = old_pagetable;
+    p->mapped_info = old_info;
+    p->total_mapped_region = old_regions;
+    p->mm_rss = old_rss;
+    p->mm_pt_pages = old_pt_pages;
+    p->mm_kobj_pages = old_kobj;
+    p->trapframe->epc = old_epc;
+    if( lender ) p->leader = lender;
+    return -1;
+  }
+
+  // we run on the kernel page table, the old one is not in use.
+  if( lender ){
+    vfork_done( p );
+  } else {
+    user_vm_free( old_pagetable );
+    free_page( old_info );
+  }
+
+  // the new image starts afresh at its entry point (set by the loader).
+  memset( &p->trapframe->regs, 0, sizeof(riscv_regs) );
+  p->trapframe->regs.sp = USER_STACK_TOP;
+  fpu_release( p );
+  memset( &p->fp, 0, sizeof(p->fp) );
+  sprint( "process %d executes %s, entry point 0x%lx.\n", p->pid, path, p->trapframe->epc );
+  return 0;
+}
+
+//
+// create a child of parent running the elf at "path" on the host. unlike fork followed
+// by exec, the address space of parent is not copied at all. returns the pid of the
+// child, or -1 if the elf cannot be loaded, or out of memory.
+//
+int do_spawn( process* parent, const char* path )
+{
+  process *child = alloc_process();
+  if( child == NULL ) return -1;
+  if( load_elf_from_host( child, path ) != EL_OK ){
+    // the child never ran, and goes away right away.
+    discard_process( child );
+    return -1;
+  }
+
+  child->mm_soft_limit = parent->leader->mm_soft_limit;
+  child->mm_hard_limit = parent->leader->mm_hard_limit;
+  child->status = READY;
+  add_child( parent, child );
+  inherit_sched( child, parent );
   insert_to_ready_queue( child );
+  sprint( "process %d spawns process %d, running %s.\n", parent->pid, child->pid, path );
 
   return child->pid;
 }
+
+//
+// create a child of parent that borrows its address space: it runs on the page table and
+// the user stack of parent, with the registers of parent but for a0 (0 in the child).
+// nothing is copied, and parent is blocked until the child execs or exits, so that its
+// stack is not changed under it. returns the pid of the child once it did, or -1 if
+// parent has threads, which run in the address space meanwhile, or is a thread or vfork
+// child itself.
+//
+int do_vfork( process* parent )
+{
+  if( parent->leader != parent || parent->nr_threads ){
+    sprint( "vfork: process %d shares its address space, and cannot vfork.\n", parent->pid );
+    return -1;
+  }
+
+  process *child = alloc_task();
+  if( child == NULL ) return -1;
+  mm_charge( child, MM_KOBJ, 2 );
+  // the memory the child maps goes to the address space of parent, and is charged to it.
+  child->leader = parent;
+  child->vfork_parent = parent;
+  parent->vfork_child = child;
+  child->pagetable = parent->pagetable;
+  child->mapped_info = parent->mapped_info;
+  child->total_mapped_region = parent->total_mapped_region;
+  mm_charge( child, MM_PAGETABLE, user_vm_map( child->pagetable, (uint64)child->trapframe,
+    PGSIZE, (uint64)child->trapframe, prot_to_type( PROT_WRITE | PROT_READ, 0 ) ) );
+
+  *child->trapframe = *parent->trapframe;
+  child->trapframe->regs.a0 = 0;
+  fpu_flush( parent );
+  child->fp = parent->fp;
+  child->mm_soft_limit = parent->mm_soft_limit;
+  child->mm_hard_limit = parent->mm_hard_limit;
+
+  child->status = READY;
+  add_child( parent, child );
+  inherit_sched( child, parent );
+  insert_to_ready_queue( child );
+
+  int pid = child->pid;
+  wait_event( &parent->child_wq, parent->vfork_child == NULL );
+  return pid;
+}
+
+//
+// create a thread of parent: a process that shares the address space of parent (its
+// page table and mapped_info), with a trapframe, kernel stack and user stack of its own.
+// it starts at entry, with arg0 and arg1 in a0 and a1, and is a child of parent, which
+// collects its exit by wait(). returns the pid of the thread, or -1 if the leader has
+// MAX_THREADS threads already, or no memory left.
+//
+int do_clone( process* parent, uint64 entry, uint64 arg0, uint64 arg1 )
+{
+  // the address space of a vfork child goes back to its parent, without the threads.
+  if( parent->vfork_parent ) return -1;
+  process *leader = parent->leader;
+  // a killed thread is on its way out, as are all threads of a killed leader.
+  if( parent->killed || leader->killed ) return -1;
+  int slot = 0;
+  while( slot < MAX_THREADS && (leader->thread_slots & (1UL << slot)) ) slot++;
+  if( slot == MAX_THREADS ) return -1;
+  if( mm_try_charge( leader, MM_RSS, 1 ) < 0 ) return -1;
+  void *stack = alloc_page();
+  if( stack == NULL ){
+    mm_uncharge( leader, MM_RSS, 1 );
+    return -1;
+  }
+
+  process *t = alloc_task();
+  if( t == NULL ){
+    free_page( stack );
+    mm_uncharge( leader, MM_RSS, 1 );
+    return -1;
+  }
+  t->leader = leader;
+  t->thread_slot = slot;
+  leader->thread_slots |= 1UL << slot;
+  t->thread_next = leader->thread_next;
+  leader->thread_next = t;
+  leader->nr_threads++;
+  t->pagetable = leader->pagetable;
+  t->mapped_info = leader->mapped_info;
+  t->total_mapped_region = leader->total_mapped_region;
+  mm_charge( t, MM_KOBJ, 2 );
+
+  // the trapframe is mapped where the trap vector finds it, as for any process.
+  mm_charge( t, MM_PAGETABLE, user_vm_map( t->pagetable, (uint64)t->trapframe, PGSIZE,
+    (uint64)t->trapframe, prot_to_type( PROT_WRITE | PROT_READ, 0 ) ) );
+  mm_charge( t, MM_PAGETABLE, user_vm_map( t->pagetable, THREAD_STACK_TOP(slot) - PGSIZE,
+    PGSIZE, (uint64)stack, prot_to_type( PROT_WRITE | PROT_READ, 1 ) ) );
+
+  // the registers of the parent (e.g., gp) carry over, but for pc, stack and argument.
+  t->trapframe->regs = parent->trapframe->regs;
+  t->trapframe->regs.sp = THREAD_STACK_TOP(slot);
+  t->trapframe->regs.a0 = arg0;
+  t->trapframe->regs.a1 = arg1;
+  t->trapframe->epc = entry;
+  fpu_flush( parent );
+  t->fp = parent->fp;
+
+  t->status = READY;
+  add_child( parent, t );
+  inherit_sched( t, parent );
+  insert_to_ready_queue( t );
+
+  return t->pid;
+}
+
+//
+// true if all threads of the leader p have exited.
+//
+static int threads_exited( process* p ) {
+  for( process *t = p->thread_next; t; t = t->thread_next )
+    if( t->status != ZOMBIE ) return 0;
+  return 1;
+}
+
+//
+// make process p exit: right away if it is blocked, at its next trap if it is running
+// on another hart (which is interrupted for it), or when it is scheduled next.
+//
+void kill_process( process* p ) {
+  p->killed = 1;
+  if( p->status == BLOCKED ){
+    del_timer( &p->sleep_timer );
+    insert_to_ready_queue( p );
+  } else if( p->status == RUNNING && p != current ){
+    smp_send_ipi( p->cpu );
+  }
+}
+
+//
+// the address space of p changed: interrupt the harts running its other threads, and
+// wait until they flushed their TLB, which they do when they take the interrupt (cf.
+// kernel/strap_vector.S). the pages unmapped before are safe to free after this.
+//
+void tlb_shootdown( process* p ) {
+  process *leader = p->leader;
+  uint64 mask = 0;
+  if( leader->status == RUNNING && leader != current ) mask |= 1UL << leader->cpu;
+  for( process *t = leader->thread_next; t; t = t->thread_next )
+    if( t->status == RUNNING && t != current ) mask |= 1UL << t->cpu;
+  process *v = leader->vfork_child;
+  if( v && v->status == RUNNING && v != current ) mask |= 1UL << v->cpu;
+  if( mask ) smp_flush_tlb( mask );
+}
+
+int proc_running_elsewhere( process* p ) {
+  process *leader = p->leader;
+  if( leader->status == RUNNING && leader != current ) return 1;
+  for( process *t = leader->thread_next; t; t = t->thread_next )
+    if( t->status == RUNNING && t != current ) return 1;
+  process *v = leader->vfork_child;
+  if( v && v->status == RUNNING && v != current ) return 1;
+  return 0;
+}
+
+//
+// terminate the current process with "code", wake up its parent if the parent waits
+// for it, and schedule another process to run.
+//
+void do_exit(uint64 code) {
+  del_timer( &current->alarm_timer );
+  // we are on our way out already, whatever killed us.
+  current->killed = 0;
+
+  // a vfork child gives the address space back to its parent, and leaves nothing of it
+  // to reclaim. a parent waits for its vfork child, which runs in its address space.
+  if( current->vfork_parent ){
+    vfork_done( current );
+    current->pagetable = NULL;
+    current->mapped_info = NULL;
+    current->total_mapped_region = 0;
+  }
+  if( current->vfork_child ) wait_event( &current->child_wq, current->vfork_child == NULL );
+
+  // the exit of a leader ends its threads first. they use its address space until they
+  // have exited, and may be blocked, or running on other harts. a thread created after
+  // the kill (by one that had not taken it yet) is killed when we wake up next.
+  while( !threads_exited( current ) ){
+    for( process *t = current->thread_next; t; t = t->thread_next )
+      if( t->status != ZOMBIE && !t->killed ) kill_process( t );
+    sleep_on( &current->child_wq );
+  }
+
+  // reclaim the current process, and reschedule. added @lab3_1
+  sched_exit( current );
+  del_timer( &current->sleep_timer );
+  futex_exit( current );
+  fpu_release( current );
+  free_process( current );
+
+  // our children are orphaned. those that exited already are released, the others
+  // when they exit.
+  while( current->first_child ){
+    process *child = current->first_child;
+    remove_child( child );
+    if( child->status == ZOMBIE ) release_process( child );
+  }
+
+  // the parent, if it waits for its children, checks them again. so does the leader of
+  // a thread, if it waits for its threads to exit.
+  if (current->parent) wake_up_all(&current->parent->child_wq);
+  if (current->leader != current) wake_up_all(&current->leader->child_wq);
+
+  // switch away for good. our kernel stack is reclaimed once another hart takes the
+  // kernel lock after the switch (cf. reap_process()).
+  schedule();
+  panic( "zombie process %d ran again.\n", current->pid );
+}
+
+//
+// total number of pages charged to process p.
+//
+static uint64 mm_total(process *p) {
+  return p->mm_rss + p->mm_pt_pages + p->mm_kobj_pages;
+}
+
+//
+// charge npages of the given type (one of mm_charge_type) to process p, unconditionally.
+// used for memory that is already allocated, or that p cannot do without. the memory of
+// threads is charged to their leader, whose address space they share.
+//
+void mm_charge(process *p, int type, uint64 npages) {
+  p = p->leader;
+  switch (type) {
+    case MM_RSS: p->mm_rss += npages; break;
+    case MM_PAGETABLE: p->mm_pt_pages += npages; break;
+    case MM_KOBJ: p->mm_kobj_pages += npages; break;
+  }
+}
+
+//
+// return npages of the given type charged to process p.
+//
+void mm_uncharge(process *p, int type, uint64 npages) {
+  p = p->leader;
+  switch (type) {
+    case MM_RSS: p->mm_rss -= npages; break;
+    case MM_PAGETABLE: p->mm_pt_pages -= npages; break;
+    case MM_KOBJ: p->mm_kobj_pages -= npages; break;
+  }
+}
+
+//
+// charge npages of the given type to process p before allocating them. if the charge
+// takes the resident set of p over its soft limit, cold pages of p are reclaimed into
+// the compressed store first. returns -1 (and charges nothing) if the charge would take
+// p over its hard limit, 0 otherwise.
+//
+int mm_try_charge(process *p, int type, uint64 npages) {
+  p = p->leader;
+  // the pages of threads running on other harts cannot be taken away from them.
+  if (type == MM_RSS && p->mm_soft_limit && p->mm_rss + npages > p->mm_soft_limit &&
+      !proc_running_elsewhere(p))
+    zram_reclaim(p, p->mm_rss + npages - p->mm_soft_limit);
+
+  if (p->mm_hard_limit && mm_total(p) + npages > p->mm_hard_limit) return -1;
+
+  mm_charge(p, type, npages);
+  return 0;
+}
@@ -2,6 +2,9 @@
 #define _PROC_H_
 
 #include "riscv.h"
+#include "smp.h"
+#include "timer.h"
+#include "wait.h"
 
 typedef struct trapframe_t {
   // space to store context (all common registers)
@@ -16,10 +19,32 @@ typedef struct trapframe_t {
 
   // kernel page table. added @lab2_1
   /* offset:272 */ uint64 kernel_satp;
+  // id of the hart the process runs on, loaded into tp on trap entry
+  /* offset:280 */ uint64 kernel_hartid;
 }trapframe;
 
-// riscv-pke kernel supports at most 32 processes
-#define NPROC 32
+// the kernel context of a process switched out inside the kernel: the registers that a
+// function call preserves, which swtch() (kernel/swtch.S) saves and restores. the
+// offsets are used in kernel/swtch.S.
+typedef struct context_t {
+  /* offset:0   */ uint64 ra;
+  /* offset:8   */ uint64 sp;
+  /* offset:16  */ uint64 s[12];  // s0 .. s11
+}context;
+
+// save the running kernel context in *old, and continue the one in *new.
+void swtch(context *old, context *new);
+
+// the floating-point registers of a process, saved and loaded lazily (kernel/fpu.c).
+// the offsets are used in kernel/fp.S.
+typedef struct fp_state_t {
+  /* offset:0   */ uint64 f[32];
+  /* offset:256 */ uint64 fcsr;
+}fp_state;
+
+// number of buckets in the hash table looking processes up by pid. there is no limit
+// on the number of processes.
+#define PID_HASH_SIZE 64
 
 // possible status of a process
 enum proc_status {
@@ -54,6 +79,12 @@ typedef struct process_t {
   pagetable_t pagetable;
   // trapframe storing the context of a (User mode) process.
   trapframe* trapframe;
+  // the kernel context of the process while it is switched out (cf. schedule()).
+  context ctx;
+  // the FP registers, as last saved, and the hart they may still be loaded on (-1 if
+  // none, cf. kernel/fpu.c)
+  fp_state fp;
+  int fp_cpu;
 
   // points to a page that contains mapped_regions. below are added @lab3_1
   mapped_region *mapped_info;
@@ -66,39 +97,149 @@ typedef struct process_t {
   int status;
   // parent process
   struct process_t *parent;
-  // waiting process
-  struct process_t *waiting;
-  // next queue element
+  // children, linked through their sibling_next/sibling_prev fields
+  struct process_t *first_child;
+  struct process_t *sibling_next, *sibling_prev;
+  // next process in the same pid hash bucket
+  struct process_t *pid_next;
+  // neighbours in the list of all processes
+  struct process_t *all_next, *all_prev;
+  // where the process waits in wait() for its children to exit
+  wait_queue child_wq;
+  // threads (cf. do_clone()). leader is the process whose address space is shared, the
+  // process itself if it is no thread. the leader links its threads through thread_next,
+  // counts those not reaped yet, and keeps the user stack slots they use.
+  struct process_t *leader;
+  struct process_t *thread_next;
+  int nr_threads;
+  uint64 thread_slots;
+  int thread_slot;
+  // vfork (cf. do_vfork()). a vfork child borrows the address space of vfork_parent, which
+  // is its leader meanwhile, until it execs or exits. the parent waits for that, and keeps
+  // the child in vfork_child.
+  struct process_t *vfork_parent;
+  struct process_t *vfork_child;
+  // next and previous queue elements
   struct process_t *queue_next;
+  struct process_t *queue_prev;
+  // the queue (kernel/sched.h) the process is linked into, NULL if none
+  struct proc_queue_t *on_queue;
 
   // accounting. added @lab3_3
   int tick_count;
+
+  // scheduling state (kernel/sched.c). on_rq is non-zero while the process is queued
+  // in the run queue of the scheduling class. cpu is the hart whose run queue the
+  // process is (or was last) in, -1 if it has never been queued.
+  int on_rq;
+  int cpu;
+  uint64 cpu_mask;  // harts the process may run on, bit i for hart i
+  int mlfq_level;   // current MLFQ level
+  int mlfq_pin;     // level the process is pinned to, -1 if none
+  int mlfq_slice;   // ticks left in the current MLFQ quantum
+  uint64 exec_start;   // time (rdtime) the process was last charged for running
+  uint64 sum_exec;     // total running time, in mtime units
+  // CFS (kernel/sched_fair.c)
+  uint64 vruntime;     // running time scaled by NICE_0_WEIGHT / cfs_weight
+  uint64 slice_start;  // sum_exec when the current slice began
+  int nice;            // -20 (largest share) .. 19
+  uint64 cfs_weight;
+  // EDF (kernel/sched_dl.c). dl_runtime is 0 for processes that are not real-time.
+  uint64 dl_runtime, dl_deadline, dl_period;  // relative, in mtime units
+  uint64 dl_abs_deadline;  // deadline of the current job
+  uint64 dl_next_period;   // start of the next job
+  int64 dl_budget;         // runtime left in the current job
+  uint64 dl_jobs, dl_misses, dl_overruns;
+  // links in the run queue heaps (CFS and EDF)
+  struct process_t *rq_left, *rq_right;
+
+  // timers (kernel/timer.c) ending a sleep, and terminating the process on its alarm
+  timer sleep_timer;
+  timer alarm_timer;
+  // non-zero if the process is to exit, instead of returning to user mode
+  int killed;
+  // the futex (physical address) the process waits on, cleared when it is woken up
+  // (cf. kernel/futex.c)
+  uint64 futex_key;
+
+  // working-set estimation, updated by the accessed/dirty bit scanner (kernel/wss.c)
+  uint64 wss_rss;        // resident user pages seen by the last scan
+  uint64 wss_pages;      // pages accessed during the last scan interval
+  uint64 wss_dirty;      // pages written during the last scan interval
+  uint64 wss_peak;       // largest working set observed so far
+  uint64 wss_scans;      // number of completed scans of this process
+
+  // non-zero if the pages of the process may be merged by kernel/ksm.c
+  int ksm_mergeable;
+
+  // memory charged to the process, in pages (cf. mm_try_charge() in kernel/process.c)
+  uint64 mm_rss;         // resident user pages
+  uint64 mm_pt_pages;    // page-table pages
+  uint64 mm_kobj_pages;  // kernel objects: kernel stack, trapframe, mapped_info
+  // limits on the charged pages, 0 for none
+  uint64 mm_soft_limit;
+  uint64 mm_hard_limit;
 }process;
 
-// switch to run user app
+// kinds of memory charged to a process
+enum mm_charge_type {
+  MM_RSS,
+  MM_PAGETABLE,
+  MM_KOBJ,
+};
+
+// return to user mode, in process proc
 void switch_to(process*);
 
-// initialize process pool (the procs[] array)
+// initialize process pool (the process cache and pid hash)
 void init_proc_pool();
 // allocate an empty process, init its vm space. returns its pid
 process* alloc_process();
+// look up a process by pid
+process* find_process( int64 pid );
 // reclaim a process, destruct its vm space and free physical pages.
 int free_process( process* proc );
+// reclaim the memory of a zombie process once its kernel stack is out of use.
+int reap_process( process* proc );
+// release a zombie process whose exit was collected
+void release_process( process* proc );
 // fork a child from parent
 int do_fork(process* parent);
-// initialize process pool (the procs[] array)
-void init_proc_pool();
-// allocate an empty process, init its vm space. returns its pid
-process* alloc_process();
-// reclaim a process, destruct its vm space and free physical pages.
-int free_process( process* proc );
-// fork a child from parent
-int do_fork(process* parent);
-
-// current running process
-extern process* current;
+// replace the image of p by a program from the host
+int do_exec(process* p, const char* path);
+// create a child of parent running a program from the host
+int do_spawn(process* parent, const char* path);
+// create a child of parent that borrows its address space until it execs or exits
+int do_vfork(process* parent);
+// create a thread of parent, running entry(arg0, arg1) on a stack of its own
+int do_clone(process* parent, uint64 entry, uint64 arg0, uint64 arg1);
+// terminate process p at its next return to user mode
+void kill_process(process* p);
+// terminate the current process, and schedule another one
+void do_exit(uint64 code);
+
+// charge memory to a process, failing if it would exceed the hard limit
+int mm_try_charge(process* p, int type, uint64 npages);
+// charge memory to a process unconditionally
+void mm_charge(process* p, int type, uint64 npages);
+// return charged memory
+void mm_uncharge(process* p, int type, uint64 npages);
+
+// current running process, one per hart (NULL if the hart is idle)
+extern process* current_percpu[NCPU];
+#define current (current_percpu[cpuid()])
+
+// true if p, or a thread sharing its address space, is running on another hart. its page
+// table may be cached in the TLB of that hart, so it must not be changed behind its back.
+int proc_running_elsewhere(process* p);
+// make the other harts running threads of p drop the stale TLB entries of its mappings,
+// and wait until they did
+void tlb_shootdown(process* p);
 
 // address of the first free page in our simple heap. added @lab2_2
 extern uint64 g_ufree_page;
-extern process procs[NPROC];
+// all processes, oldest first, and the number of them that have not exited
+extern process* g_proc_list;
+extern int g_nr_live;
+#define for_each_process(p) for ((p) = g_proc_list; (p); (p) = (p)->all_next)
 #endif
@@ -54,13 +54,17 @@
 
 // irqs (interrupts). added @lab1_3
 #define CAUSE_MTIMER 0x8000000000000007
+#define CAUSE_MSOFT 0x8000000000000003
 #define CAUSE_MTIMER_S_TRAP 0x8000000000000001
+#define CAUSE_STIMER_S_TRAP 0x8000000000000005
 
 //Supervisor interrupt-pending register
 #define SIP_SSIP (1L << 1)
+#define SIP_STIP (1L << 5)
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4 * (hartid))  // software interrupt pending
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8 * (hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8)  // cycles since boot.
 
@@ -72,6 +76,9 @@
 #define SSTATUS_UIE (1L << 0)   // User Interrupt Enable
 #define SSTATUS_SUM 0x00040000
 #define SSTATUS_FS 0x00006000
+#define SSTATUS_FS_OFF 0x00000000      // FP instructions trap
+#define SSTATUS_FS_CLEAN 0x00004000    // FP registers unchanged since last saved
+#define SSTATUS_FS_DIRTY 0x00006000    // FP registers written
 
 // Supervisor Interrupt Enable
 #define SIE_SEIE (1L << 9)  // external
@@ -117,6 +124,14 @@ static inline int supports_extension(char ext) {
     __tmp;                                                            \
   })
 
+// the Sstc extension: S-mode sets its own timer in stimecmp, once M-mode sets
+// menvcfg.STCE. the csrs are accessed by number, for assemblers that lack their names.
+#define MENVCFG_STCE (1UL << 63)
+static inline unsigned long read_menvcfg(void) { return read_csr(0x30a); }
+static inline void write_menvcfg(unsigned long x) { write_csr(0x30a, x); }
+static inline void write_stimecmp(unsigned long x) { write_csr(0x14d, x); }
+static inline unsigned long read_stimecmp(void) { return read_csr(0x14d); }
+
 // enable device interrupts
 static inline void intr_on(void) { write_csr(sstatus, read_csr(sstatus) | SSTATUS_SIE); }
 
@@ -186,9 +201,14 @@ static inline void flush_tlb(void) { asm volatile("sfence.vma zero, zero"); }
 #define PGSIZE 4096  // bytes per page
 #define PGSHIFT 12   // offset bits within a page
 
-// use riscv's sv39 page table scheme.
+// riscv's sv39 and sv48 page table schemes. the one in use is selected at boot, and
+// recorded in g_satp_mode and g_pt_levels (kernel/vmm.c).
 #define SATP_SV39 (8L << 60)
-#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+#define SATP_SV48 (9L << 60)
+#define SATP_MODE_MASK (0xFL << 60)
+#define MAKE_SATP(pagetable) (g_satp_mode | (((uint64)pagetable) >> 12))
+extern uint64 g_satp_mode;
+extern int g_pt_levels;
 
 #define PTE_V (1L << 0)  // valid
 #define PTE_R (1L << 1)  // readable
@@ -198,6 +218,8 @@ static inline void flush_tlb(void) { asm volatile("sfence.vma zero, zero"); }
 #define PTE_G (1L << 5)  // global
 #define PTE_A (1L << 6)  // accessed
 #define PTE_D (1L << 7)  // dirty
+#define PTE_COW (1L << 8)  // (software) write-protected shared page, copied on write
+#define PTE_ZRAM (1L << 9) // (software) with PTE_V clear: page is in the compressed store
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -208,7 +230,7 @@ static inline void flush_tlb(void) { asm volatile("sfence.vma zero, zero"); }
 // extract the property bits of a pte
 #define PTE_FLAGS(pte) ((pte)&0x3FF)
 
-// extract the three 9-bit page table indices from a virtual address.
+// extract the 9-bit page table indices from a virtual address.
 #define PXMASK 0x1FF  // 9 bits
 
 #define PXSHIFT(level) (PGSHIFT + (9 * (level)))
@@ -216,9 +238,9 @@ static inline void flush_tlb(void) { asm volatile("sfence.vma zero, zero"); }
 
 // one beyond the highest possible virtual address.
 // MAXVA is actually one bit less than the max allowed by
-// Sv39, to avoid having to sign-extend virtual addresses
+// Sv39 (Sv48), to avoid having to sign-extend virtual addresses
 // that have the high bit set.
-#define MAXVA (1L << (9 + 9 + 9 + 12 - 1))
+#define MAXVA (1L << (9 * g_pt_levels + 12 - 1))
 
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t;  // 512 PTEs
@@ -0,0 +1,23 @@
+#ifndef _SBI_H_
+#define _SBI_H_
+
+#include "util/types.h"
+
+// services of the M-mode part of PKE (cf. kernel/machine/mtrap.c) to the S-mode kernel.
+// the kernel requests one by an ecall, with the service number in a7 and its argument
+// in a0. the result comes back in a0.
+#define SBI_SEND_IPI 0   // raise a software interrupt on hart a0
+#define SBI_SET_TIMER 1  // fire the timer of this hart at time a0 (mtime), -1 for never
+
+// non-zero if the harts have the Sstc extension, and the kernel sets its timer in
+// stimecmp instead of through SBI_SET_TIMER (cf. kernel/machine/minit.c).
+extern volatile int g_sstc;
+
+static inline uint64 sbi_call(uint64 which, uint64 arg) {
+  register uint64 a0 asm("a0") = arg;
+  register uint64 a7 asm("a7") = which;
+  asm volatile("ecall" : "+r"(a0) : "r"(a7) : "memory");
+  return a0;
+}
+
+#endif
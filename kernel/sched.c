@@ -3,104 +3,587 @@
  */
 
 #include "sched.h"
+#include "pmm.h"
+#include "strap.h"
+#include "fpu.h"
+#include "util/string.h"
 #include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_bootargs.h"
+#include "spike_interface/atomic.h"
 
-process* ready_queue_head = NULL;
-process* blocked_queue_head = NULL;
+static const sched_class *g_classes[] = {
+  [SCHED_RR] = &rr_sched_class,
+  [SCHED_MLFQ] = &mlfq_sched_class,
+  [SCHED_CFS] = &cfs_sched_class,
+};
+static const sched_class *g_sched_class;
+
+// the class of proc: real-time processes are scheduled by EDF, above all others.
+#define class_of(proc) ((proc)->dl_runtime ? &dl_sched_class : g_sched_class)
+
+// one run queue per hart. a process stays in the queue of its hart (proc->cpu).
+run_queue g_rqs[NCPU];
+#define this_rq() (&g_rqs[cpuid()])
 
 //
-// insert a process, proc, into the END of ready queue.
+// append proc to the tail of queue q.
 //
-void insert_to_ready_queue( process* proc ) {
-  sprint( "going to insert process %d to ready queue.\n", proc->pid );
-  // if the queue is empty in the beginning
-  if( ready_queue_head == NULL ){
-    proc->status = READY;
-    proc->queue_next = NULL;
-    ready_queue_head = proc;
-    return;
+void proc_queue_push(proc_queue *q, process *proc) {
+  assert(proc->on_queue == NULL);
+  proc->queue_next = NULL;
+  proc->queue_prev = q->tail;
+  if (q->tail)
+    q->tail->queue_next = proc;
+  else
+    q->head = proc;
+  q->tail = proc;
+  proc->on_queue = q;
+  q->nr++;
+}
+
+//
+// unlink proc from queue q, wherever it sits in the queue.
+//
+void proc_queue_remove(proc_queue *q, process *proc) {
+  assert(proc->on_queue == q);
+  if (proc->queue_prev)
+    proc->queue_prev->queue_next = proc->queue_next;
+  else
+    q->head = proc->queue_next;
+  if (proc->queue_next)
+    proc->queue_next->queue_prev = proc->queue_prev;
+  else
+    q->tail = proc->queue_prev;
+  proc->queue_next = proc->queue_prev = NULL;
+  proc->on_queue = NULL;
+  q->nr--;
+}
+
+//
+// take the process at the head of queue q, NULL if q is empty.
+//
+process *proc_queue_pop(proc_queue *q) {
+  process *proc = q->head;
+  if (proc) proc_queue_remove(q, proc);
+  return proc;
+}
+
+//
+// select the scheduling class: SCHED_POLICY, unless "sched=<name>" is given in the
+// bootargs.
+//
+void sched_init() {
+  char name[16];
+  g_sched_class = g_classes[SCHED_POLICY];
+  if (bootarg_get("sched", name, sizeof(name)) == 0) {
+    int i;
+    for (i = 0; i < sizeof(g_classes) / sizeof(g_classes[0]); i++)
+      if (strcmp(g_classes[i]->name, name) == 0) break;
+    if (i < sizeof(g_classes) / sizeof(g_classes[0]))
+      g_sched_class = g_classes[i];
+    else
+      sprint("unknown scheduler \"%s\", ignored.\n", name);
   }
+  sprint("scheduler: %s\n", g_sched_class->name);
+}
 
-  // ready queue is not empty
-  process *p;
-  // browse the ready queue to see if proc is already in-queue
-  for( p=ready_queue_head; p->queue_next!=NULL; p=p->queue_next )
-    if( p == proc ) return;  //already in queue
+//
+// charge the time the current process has been running since it was last charged.
+//
+static void update_curr() {
+  uint64 now = read_csr(time);
+  uint64 delta = now - current->exec_start;
+  current->exec_start = now;
+  current->sum_exec += delta;
+  if (class_of(current)->charge) class_of(current)->charge(this_rq(), current, delta);
+}
 
-  // p points to the last element of the ready queue
-  if( p==proc ) return;
-  p->queue_next = proc;
+//
+// choose the run queue for proc: the hart it ran on before (real-time processes always
+// stay there), or the least loaded hart for a new process, or one that is no longer
+// allowed by its cpu_mask.
+//
+static run_queue *select_rq( process* proc ) {
+  if( proc->cpu >= 0 && (proc->cpu_mask & (1L << proc->cpu)) ) return &g_rqs[proc->cpu];
+
+  int best = cpuid(), best_load = -1;
+  for( int i = 0; i < NCPU; i++ ){
+    int cpu = (cpuid() + i) % NCPU;
+    if( !g_cpu_online[cpu] || !(proc->cpu_mask & (1L << cpu)) ) continue;
+    int load = g_rqs[cpu].nr_running + (current_percpu[cpu] != NULL);
+    if( best_load < 0 || load < best_load ){
+      best = cpu;
+      best_load = load;
+    }
+  }
+  return &g_rqs[best];
+}
+
+//
+// proc was queued on rq: wake the hart of rq up if it sleeps in its idle loop. if that
+// hart is busy, wake up an idle one, which can steal proc.
+//
+static void kick_idle_hart( run_queue *rq, process *proc ) {
+  int cpu = rq - g_rqs;
+  int idle = ( current_percpu[cpu] == NULL );
+  // in tickless mode, a busy hart may have no tick set up to preempt its process.
+  if( cpu != cpuid() && (idle || TIMER_TICKLESS) ) smp_send_ipi( cpu );
+  // the current process of this hart, preempted, runs again right away.
+  if( idle || proc == current ) return;
+  for( int i = 0; i < NCPU; i++ )
+    if( i != cpuid() && i != cpu && g_cpu_online[i] && current_percpu[i] == NULL ){
+      smp_send_ipi( i );
+      return;
+    }
+}
+
+//
+// insert a process, proc, into the ready queue. where it is placed is decided by the
+// scheduling class. a process that sits in another queue (e.g., a blocked process being
+// woken up) is moved.
+//
+static void enqueue_ready( process* proc, int preempted ) {
+  if( proc->on_rq ) return;  //already in queue
+  if( proc->on_queue ) proc_queue_remove( proc->on_queue, proc );
+
+  // the running process is charged before it is queued by its new position. a
+  // real-time process out of budget, or done with its job, waits for its next period.
+  if( proc == current && proc->status == RUNNING ){
+    update_curr();
+    if( proc->dl_runtime && dl_throttle( this_rq(), proc, preempted ) ) return;
+  }
+
+  run_queue *rq = select_rq( proc );
+  proc->cpu = rq - g_rqs;
   proc->status = READY;
-  proc->queue_next = NULL;
+  proc->on_rq = 1;
+  rq->nr_running++;
+  class_of( proc )->enqueue( rq, proc, preempted );
+  kick_idle_hart( rq, proc );
+}
 
-  return;
+void insert_to_ready_queue( process* proc ) {
+  enqueue_ready( proc, 0 );
 }
 
 //
-// insert a process, proc, into the END of blocked queue.
+// block the current process at the END of wait queue wq, and schedule. returns once
+// the process is woken up and runs again.
 //
-void insert_to_blocked_queue(process *proc)
+void sleep_on(wait_queue *wq)
 {
-  // sprint( "going to insert process %d to blocked queue.\n", proc->pid );
-  // if the queue is empty in the beginning
-  if (blocked_queue_head == NULL)
-  {
-    proc->status = BLOCKED;
-    proc->queue_next = NULL;
-    blocked_queue_head = proc;
-    return;
+  current->status = BLOCKED;
+  proc_queue_push(wq, current);
+  schedule();
+}
+
+//
+// move the first process waiting in wq to the ready queue.
+//
+void wake_up_one(wait_queue *wq)
+{
+  if (wq->head) insert_to_ready_queue(wq->head);
+}
+
+//
+// move all processes waiting in wq to the ready queue.
+//
+void wake_up_all(wait_queue *wq)
+{
+  while (wq->head) insert_to_ready_queue(wq->head);
+}
+
+//
+// true if proc, queued on another hart, may be moved to hart "cpu". a process that
+// stopped running less than SCHED_MIGRATION_COST ago is likely to still have its data
+// in the caches of its hart, it is moved only if allow_hot is set.
+//
+int sched_can_migrate(process *proc, int cpu, int allow_hot) {
+  if ( proc->dl_runtime || !(proc->cpu_mask & (1L << cpu)) ) return 0;
+  if ( !allow_hot && read_csr(time) - proc->exec_start < SCHED_MIGRATION_COST ) return 0;
+  return 1;
+}
+
+//
+// move one runnable process from the tail of run queue src to run queue dst. returns
+// 1 if a process was moved.
+//
+static int migrate_one( run_queue *src, run_queue *dst, int allow_hot ) {
+  if ( !g_sched_class->steal || src->nr_running == 0 ) return 0;
+  process *proc = g_sched_class->steal( src, dst, allow_hot );
+  if ( !proc ) return 0;
+
+  src->nr_running--;
+  proc->cpu = dst - g_rqs;
+  dst->nr_running++;
+  g_sched_class->enqueue( dst, proc, 1 );
+  return 1;
+}
+
+//
+// the hart to steal from: the one with the most queued processes, among those busy
+// running a process (an idle hart picks up its own queue soon enough).
+//
+static int find_victim() {
+  int victim = -1;
+  for ( int i = 0; i < NCPU; i++ ) {
+    if ( i == cpuid() || !g_cpu_online[i] || current_percpu[i] == NULL ) continue;
+    int n = atomic_read( &g_rqs[i].nr_running );
+    if ( n > 0 && (victim < 0 || n > g_rqs[victim].nr_running) ) victim = i;
+  }
+  return victim;
+}
+
+//
+// this hart is idle: steal a process from a busy hart.
+//
+static int steal_task( run_queue *rq ) {
+  int victim = find_victim();
+  return victim >= 0 && migrate_one( &g_rqs[victim], rq, 1 );
+}
+
+//
+// periodic rebalance, run by hart 0: if the busiest hart has at least two processes
+// more than the idlest, move one, unless all candidates are cache hot.
+//
+static void rebalance() {
+  int busiest = -1, idlest = -1, max = 0, min = 0;
+  for ( int i = 0; i < NCPU; i++ ) {
+    if ( !g_cpu_online[i] ) continue;
+    int load = g_rqs[i].nr_running + (current_percpu[i] != NULL);
+    if ( busiest < 0 || load > max ) { busiest = i; max = load; }
+    if ( idlest < 0 || load < min ) { idlest = i; min = load; }
   }
+  if ( busiest >= 0 && max - min >= 2 ) migrate_one( &g_rqs[busiest], &g_rqs[idlest], 0 );
+}
+
+// the stacks harts run on while idle, and the kernel contexts of their idle loops. the
+// kernel stack of the last process is not used, as that process may be woken up and
+// stolen by another hart meanwhile.
+__attribute__((aligned(16))) static char g_idle_stack[NCPU][PGSIZE];
+static context g_idle_ctx[NCPU];
+
+//
+// continue on the stack sp with fn, which never returns.
+//
+static void __attribute__((noreturn)) run_on_stack( uint64 sp, void (*fn)(void) ) {
+  asm volatile( "mv sp, %0\n\tjr %1" : : "r"(sp), "r"(fn) );
+  __builtin_unreachable();
+}
+
+//
+// take the next process to run on this hart out of the run queue, stealing one from a
+// busy hart if the queue is empty. returns NULL if there is none.
+//
+static process *pick_next( run_queue *rq ) {
+  // a throttled real-time process may be due for its next period.
+  dl_update( rq );
+  if ( rq->nr_running == 0 && !steal_task( rq ) ) return NULL;
+
+  process *next = ( rq->dl_root ? &dl_sched_class : g_sched_class )->pick_next( rq );
+  next->on_rq = 0;
+  next->exec_start = read_csr(time);
+  rq->nr_running--;
+  assert( next->status == READY && next->cpu == cpuid() );
 
-  // blocked queue is not empty
+  next->status = RUNNING;
+  sprint( "going to schedule process %d to run.\n", next->pid );
+  return next;
+}
+
+//
+// do a bit of the work left for idle harts: reclaim the memory of one zombie process,
+// or else zero some free pages ahead of time. returns zero if there was nothing to do.
+//
+static int idle_work() {
   process *p;
-  // browse the ready queue to see if proc is already in-queue
-  for (p = blocked_queue_head; p->queue_next != NULL; p = p->queue_next)
-    if (p == proc)
-      return; // already in queue
-
-  // p points to the last element of the ready queue
-  if (p == proc)
-    return;
-  p->queue_next = proc;
-  proc->status = BLOCKED;
-  proc->queue_next = NULL;
+  for_each_process( p ) {
+    if( p->status != ZOMBIE ) continue;
+    // a zombie no parent will wait for goes away altogether.
+    if( p->parent == NULL ){
+      release_process( p );
+      return 1;
+    }
+    if( reap_process( p ) ) return 1;
+  }
+  return pmm_zero_pages( IDLE_ZERO_BATCH );
+}
+
+//
+// sleep, outside the kernel lock, until an interrupt: a timer tick, or an IPI from a
+// hart that queued work for us (cf. kick_idle_hart()). the time asleep is accounted as
+// idle time of the hart.
+//
+static void idle_sleep( run_queue *rq ) {
+  program_timer();
+  kernel_unlock();
+  uint64 start = read_csr(time);
+  // interrupts stay disabled (sstatus.SIE), as the trap vector only expects traps from
+  // user mode. a pending soft interrupt still ends the wfi, and stays pending for us.
+  if( atomic_read( &rq->nr_running ) == 0 && find_victim() < 0 ) asm volatile( "wfi" );
+  rq->idle_time += read_csr(time) - start;
+  kernel_lock();
 
-  return;
+  if( ack_timer_irq() ){
+    handle_mtimer_trap();
+    rq->ticks++;
+  }
 }
 
 //
-// choose a proc from the ready queue, and put it to run.
-// note: schedule() does not take care of previous current process. If the current
-// process is still runnable, you should place it into the ready queue (by calling
-// ready_queue_insert), and then call schedule().
+// the idle loop of a hart, which runs on its idle stack. it switches to the processes
+// queued on the hart, and gets the hart back when none is left (cf. schedule()). if all
+// processes are gone, it shuts down. otherwise it does some background work, or sleeps,
+// until work shows up in the run queue of this hart or of a busy one to steal from.
 //
-extern process procs[NPROC];
-void schedule() {
-  if ( !ready_queue_head ){
-    // by default, if there are no ready process, and all processes are in the status of
-    // FREE and ZOMBIE, we should shutdown the emulated RISC-V machine.
-    int should_shutdown = 1;
+static void idle_loop() {
+  run_queue *rq = this_rq();
 
-    for( int i=0; i<NPROC; i++ )
-      if( (procs[i].status != FREE) && (procs[i].status != ZOMBIE) ){
-        should_shutdown = 0;
-        sprint( "ready queue empty, but process %d is not in free/zombie state:%d\n", 
-          i, procs[i].status );
-      }
+  while ( 1 ) {
+    process *next = pick_next( rq );
+    if ( next ) {
+      current = next;
+      swtch( &g_idle_ctx[cpuid()], &next->ctx );
+      continue;
+    }
 
-    if( should_shutdown ){
+    // by default, if there are no ready process, and all processes are in the status of
+    // FREE and ZOMBIE, we should shutdown the emulated RISC-V machine.
+    if( g_nr_live == 0 ){
+      for( int i = 0; i < NCPU; i++ )
+        if( g_cpu_online[i] ) sprint( "hart %d idle for %ld ticks of mtime.\n", i, g_rqs[i].idle_time );
       sprint( "no more ready processes, system shutdown now.\n" );
       shutdown( 0 );
-    }else{
+    }
+
+    // if no hart has anything to run, and no timer is pending, nothing will ever wake
+    // the blocked processes up.
+    int stuck = ( timer_nr_pending() == 0 );
+    for( int i=0; i<NCPU; i++ ){
+      if( g_rqs[i].nr_running || g_rqs[i].dl_throttled.head ) stuck = 0;
+      if( i != cpuid() && current_percpu[i] && current_percpu[i]->status == RUNNING ) stuck = 0;
+    }
+    if( stuck ){
+      process *p;
+      for_each_process( p )
+        if( p->status != ZOMBIE )
+          sprint( "ready queue empty, but process %d is not in free/zombie state:%d\n",
+            p->pid, p->status );
       panic( "Not handled: we should let system wait for unfinished processes.\n" );
     }
+
+    if( !idle_work() ) idle_sleep( rq );
   }
+}
 
-  current = ready_queue_head;
-  assert( current->status == READY );
-  ready_queue_head = ready_queue_head->queue_next;
+//
+// enter the idle loop of this hart, which then runs the processes queued on it. called
+// once by every hart, holding the kernel lock, at the end of its boot.
+//
+void sched_start() {
+  run_on_stack( (uint64)g_idle_stack[cpuid()] + PGSIZE, idle_loop );
+}
 
-  current->status = RUNNING;
-  sprint( "going to schedule process %d to run.\n", current->pid );
-  switch_to( current );
+//
+// switch from the current process to the next one in the ready queue of this hart, or
+// to the idle loop if there is none, and return when the current process is switched
+// back to (maybe on another hart).
+// note: schedule() does not take care of previous current process. If the current
+// process is still runnable, you should place it into the ready queue (by calling
+// insert_to_ready_queue), and then call schedule().
+//
+void schedule() {
+  process *prev = current;
+  assert( prev );
+
+  // a process that blocked or exited is charged for its last run.
+  if ( !prev->on_rq ) update_curr();
+
+  process *next = pick_next( this_rq() );
+  current = next;
+  // only the kernel contexts are swapped. the kernel lock is held across the switch,
+  // and the process switched to releases it when it returns to user mode.
+  if ( next != prev ) {
+    fpu_flush( prev );
+    swtch( &prev->ctx, next ? &next->ctx : &g_idle_ctx[cpuid()] );
+  }
+
+  // a process killed while it was waiting exits instead.
+  if( current->killed ) do_exit( -1 );
+}
+
+//
+// charge a timer tick to the current process. returns non-zero if its time is up.
+//
+int sched_tick() {
+  run_queue *rq = this_rq();
+  rq->ticks++;
+  update_curr();
+  dl_update( rq );
+  if ( cpuid() == 0 && rq->ticks % SCHED_REBALANCE_INTERVAL == 0 ) rebalance();
+  // a runnable real-time process preempts any normal one.
+  if ( !current->dl_runtime && rq->dl_root ) return 1;
+  return class_of( current )->tick( rq, current );
+}
+
+//
+// tickless mode: the time the next scheduler tick of this hart is due, -1 if it needs
+// none, because its current process has the hart to itself (or it has no process).
+// the real-time processes of the hart, and hart 0, which rebalances the others, also
+// need ticks.
+//
+uint64 sched_next_tick( uint64 now ) {
+  run_queue *rq = this_rq();
+  int need = ( rq->dl_throttled.head != NULL );
+  if( current ) need |= ( rq->nr_running || current->dl_runtime );
+  if( current && cpuid() == 0 )
+    for( int i = 0; i < NCPU; i++ ) need |= ( g_rqs[i].nr_running > 0 );
+  if( !need ){
+    rq->next_tick = -1UL;
+    return -1UL;
+  }
+
+  // a tick already due stays where it is, so that returning to user mode often does not
+  // push it back.
+  if( rq->next_tick == -1UL || rq->next_tick <= now )
+    rq->next_tick = now + TIMER_INTERVAL;
+  return rq->next_tick;
+}
+
+//
+// tickless mode: true if the scheduler tick of this hart is due at "now". the timer
+// also fires for the kernel timers and the scanners, which are no ticks.
+//
+int sched_tick_due( uint64 now ) {
+  return this_rq()->next_tick <= now;
 }
+
+//
+// put the current process, whose time is up, back into the ready queue, and schedule.
+//
+void sched_preempt() {
+  enqueue_ready( current, 1 );
+  schedule();
+}
+
+//
+// set the scheduling priority of proc, whose meaning depends on the scheduling class.
+//
+int sched_set_prio(process *proc, int prio) {
+  if ( !g_sched_class->set_prio ) return -1;
+  return g_sched_class->set_prio( proc->cpu >= 0 ? &g_rqs[proc->cpu] : this_rq(), proc, prio );
+}
+
+//
+// restrict proc to the harts in mask. a queued process moves to an allowed hart right
+// away, the calling process too, a process running on another hart does when it is
+// next requeued. returns -1 if mask has no running hart, or would move a real-time
+// process off its hart.
+//
+int sched_setaffinity(process *proc, uint64 mask) {
+  uint64 online = 0;
+  for ( int i = 0; i < NCPU; i++ )
+    if ( g_cpu_online[i] ) online |= 1L << i;
+  if ( (mask & online) == 0 ) return -1;
+  if ( proc->dl_runtime && !(mask & (1L << proc->cpu)) ) return -1;
+
+  proc->cpu_mask = mask;
+  if ( proc->cpu < 0 || (mask & (1L << proc->cpu)) ) return 0;
+
+  if ( proc->on_rq ) {
+    run_queue *rq = &g_rqs[proc->cpu];
+    g_sched_class->dequeue( rq, proc );
+    rq->nr_running--;
+    proc->on_rq = 0;
+    enqueue_ready( proc, 1 );
+  } else if ( proc == current ) {
+    // the caller continues on the new hart.
+    enqueue_ready( proc, 1 );
+    schedule();
+  }
+  return 0;
+}
+
+//
+// make the running process proc a real-time process with the given runtime, relative
+// deadline and period (in mtime units), or a normal process again if runtime is 0.
+// real-time processes stay on their hart, and are admitted per hart. returns -1 if the
+// parameters are invalid, or the hart would be overloaded.
+//
+int sched_setattr(process *proc, uint64 runtime, uint64 deadline, uint64 period) {
+  assert( proc == current );
+  if ( runtime && (runtime > deadline || deadline > period) ) return -1;
+
+  run_queue *rq = this_rq();
+  uint64 old_bw = proc->dl_runtime ? dl_bw( proc->dl_runtime, proc->dl_period ) : 0;
+  uint64 new_bw = runtime ? dl_bw( runtime, period ) : 0;
+  if ( rq->dl_bw - old_bw + new_bw > dl_bw( DL_BW_LIMIT, 100 ) ) return -1;
+
+  rq->dl_bw = rq->dl_bw - old_bw + new_bw;
+  proc->dl_runtime = runtime;
+  proc->dl_deadline = deadline;
+  proc->dl_period = period;
+  if ( runtime ) dl_new_job( proc, read_csr(time) );
+  return 0;
+}
+
+//
+// release the scheduling resources of proc, which is exiting.
+//
+void sched_exit(process *proc) {
+  if ( proc->dl_runtime ) g_rqs[proc->cpu].dl_bw -= dl_bw( proc->dl_runtime, proc->dl_period );
+  proc->dl_runtime = 0;
+}
+
+//
+// the utilization admitted for the real-time processes on the hart of proc, in per
+// mille.
+//
+uint64 sched_dl_bw(process *proc) {
+  run_queue *rq = proc->cpu >= 0 ? &g_rqs[proc->cpu] : this_rq();
+  return rq->dl_bw * 1000 / dl_bw( 1, 1 );
+}
+
+//
+// the round-robin class: a FIFO queue, every process runs for TIME_SLICE_LEN ticks.
+//
+static void rr_enqueue(run_queue *rq, process *proc, int preempted) {
+  proc_queue_push(&rq->fifo, proc);
+}
+
+static process *rr_pick_next(run_queue *rq) {
+  return proc_queue_pop(&rq->fifo);
+}
+
+static void rr_dequeue(run_queue *rq, process *proc) {
+  proc_queue_remove(&rq->fifo, proc);
+}
+
+static process *rr_steal(run_queue *src, run_queue *dst, int allow_hot) {
+  for (process *proc = src->fifo.tail; proc; proc = proc->queue_prev)
+    if (sched_can_migrate(proc, dst - g_rqs, allow_hot)) {
+      proc_queue_remove(&src->fifo, proc);
+      return proc;
+    }
+  return NULL;
+}
+
+static int rr_tick(run_queue *rq, process *proc) {
+  if (proc->tick_count + 1 >= TIME_SLICE_LEN) {
+    proc->tick_count = 0;
+    return 1;
+  }
+  proc->tick_count++;
+  return 0;
+}
+
+const sched_class rr_sched_class = {
+  .name = "rr",
+  .enqueue = rr_enqueue,
+  .dequeue = rr_dequeue,
+  .pick_next = rr_pick_next,
+  .tick = rr_tick,
+  .set_prio = NULL,
+  .charge = NULL,
+  .steal = rr_steal,
+};
@@ -1,13 +1,81 @@
 #ifndef _SCHED_H_
 #define _SCHED_H_
 
+#include "config.h"
 #include "process.h"
 
 //length of a time slice, in number of ticks
 #define TIME_SLICE_LEN  2
 
+// the runnable processes. each scheduling class keeps its processes in its own part.
+typedef struct run_queue_t {
+  int nr_running;
+  uint64 ticks;                   // timer ticks charged to processes of this queue
+  proc_queue fifo;                // SCHED_RR
+  proc_queue level[MLFQ_LEVELS];  // SCHED_MLFQ, level[0] has the highest priority
+  // SCHED_CFS: a heap ordered by vruntime, the sum of the weights in it, and the
+  // (monotonic) smallest vruntime.
+  process *cfs_root;
+  uint64 cfs_load;
+  uint64 min_vruntime;
+  // EDF: a heap of real-time processes ordered by deadline, and those waiting for
+  // their next period.
+  process *dl_root;
+  proc_queue dl_throttled;
+  uint64 dl_bw;  // utilization admitted on this hart
+  uint64 idle_time;  // mtime units the hart spent asleep in its idle loop
+  uint64 next_tick;  // tickless mode: when the next scheduler tick is due
+} run_queue;
+
+// CFS weight of a process of nice 0
+#define NICE_0_WEIGHT 1024
+
+// a scheduling class decides the order in which runnable processes get the processor.
+typedef struct sched_class_t {
+  const char *name;
+  // queue proc. "preempted" is non-zero if proc was running and its time is up,
+  // zero if it is new, woken up, or gave up the processor by itself.
+  void (*enqueue)(run_queue *rq, process *proc, int preempted);
+  // remove the queued process proc from rq.
+  void (*dequeue)(run_queue *rq, process *proc);
+  // dequeue and return the next process to run. called only if rq is not empty.
+  process *(*pick_next)(run_queue *rq);
+  // charge a timer tick to the running process proc. returns non-zero if proc should
+  // be preempted.
+  int (*tick)(run_queue *rq, process *proc);
+  // set the priority of proc (class specific), returns -1 if prio is not accepted.
+  int (*set_prio)(run_queue *rq, process *proc, int prio);
+  // account delta (mtime units) of running time to the running process proc. optional.
+  void (*charge)(run_queue *rq, process *proc, uint64 delta);
+  // dequeue a process that may move to run queue dst (cf. sched_can_migrate()),
+  // preferably the one that would run last. returns NULL if there is none.
+  process *(*steal)(run_queue *src, run_queue *dst, int allow_hot);
+} sched_class;
+
+extern const sched_class rr_sched_class;
+extern const sched_class mlfq_sched_class;
+extern const sched_class cfs_sched_class;
+extern const sched_class dl_sched_class;
+
+// EDF helpers (kernel/sched_dl.c)
+uint64 dl_bw(uint64 runtime, uint64 period);
+void dl_new_job(process *proc, uint64 start);
+int dl_throttle(run_queue *rq, process *proc, int preempted);
+void dl_update(run_queue *rq);
+
+void sched_init();
 void insert_to_ready_queue( process* proc );
-void insert_to_blocked_queue(process *proc);
+void sched_start();
 void schedule();
-extern process *blocked_queue_head;
+int sched_tick();
+int sched_can_migrate(process *proc, int cpu, int allow_hot);
+void sched_preempt();
+int sched_set_prio(process *proc, int prio);
+int sched_setaffinity(process *proc, uint64 mask);
+int sched_setattr(process *proc, uint64 runtime, uint64 deadline, uint64 period);
+uint64 sched_next_tick(uint64 now);
+int sched_tick_due(uint64 now);
+void sched_exit(process *proc);
+uint64 sched_dl_bw(process *proc);
+extern run_queue g_rqs[NCPU];
 #endif
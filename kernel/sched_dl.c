@@ -0,0 +1,147 @@
+/*
+ * the earliest-deadline-first (EDF) real-time scheduling class.
+ *
+ * a real-time process runs periodic jobs: every dl_period it may run for dl_runtime,
+ * and should finish within dl_deadline from the start of the period. the runnable
+ * process with the earliest deadline runs first, before any process of the normal
+ * scheduling class. a process that uses up its budget, or finishes its job by yielding,
+ * is throttled until its next period. a job still unfinished at its deadline counts
+ * as a miss, and the process starts over with a new job.
+ */
+
+#include "sched.h"
+#include "spike_interface/spike_utils.h"
+
+// utilization is kept in fixed point, 1 << DL_BW_SHIFT is the whole processor
+#define DL_BW_SHIFT 20
+
+uint64 dl_bw(uint64 runtime, uint64 period) {
+  return (runtime << DL_BW_SHIFT) / period;
+}
+
+//
+// start a new job of proc at time start.
+//
+void dl_new_job(process *proc, uint64 start) {
+  proc->dl_abs_deadline = start + proc->dl_deadline;
+  proc->dl_next_period = start + proc->dl_period;
+  proc->dl_budget = proc->dl_runtime;
+  proc->dl_jobs++;
+}
+
+//
+// merge two skew heaps ordered by deadline, returns the new root.
+//
+static process *dl_merge(process *a, process *b) {
+  if (!a) return b;
+  if (!b) return a;
+  if (b->dl_abs_deadline < a->dl_abs_deadline) {
+    process *t = a;
+    a = b;
+    b = t;
+  }
+  process *t = a->rq_left;
+  a->rq_left = dl_merge(a->rq_right, b);
+  a->rq_right = t;
+  return a;
+}
+
+static process *dl_pop(run_queue *rq) {
+  process *proc = rq->dl_root;
+  rq->dl_root = dl_merge(proc->rq_left, proc->rq_right);
+  proc->rq_left = proc->rq_right = NULL;
+  return proc;
+}
+
+static void dl_push(run_queue *rq, process *proc) {
+  proc->rq_left = proc->rq_right = NULL;
+  rq->dl_root = dl_merge(rq->dl_root, proc);
+}
+
+static void dl_enqueue(run_queue *rq, process *proc, int preempted) {
+  // a process waking up after its deadline has passed starts a new job.
+  if (!preempted) {
+    uint64 now = read_csr(time);
+    if (now >= proc->dl_abs_deadline) dl_new_job(proc, now);
+  }
+  dl_push(rq, proc);
+}
+
+static process *dl_pick_next(run_queue *rq) {
+  if (!rq->dl_root) panic("edf: pick_next on an empty run queue.\n");
+  return dl_pop(rq);
+}
+
+static void dl_charge(run_queue *rq, process *proc, uint64 delta) {
+  proc->dl_budget -= delta;
+}
+
+static int dl_tick(run_queue *rq, process *proc) {
+  // out of budget, or a job with an earlier deadline is waiting.
+  if (proc->dl_budget <= 0) return 1;
+  return rq->dl_root && rq->dl_root->dl_abs_deadline < proc->dl_abs_deadline;
+}
+
+const sched_class dl_sched_class = {
+  .name = "edf",
+  .enqueue = dl_enqueue,
+  .dequeue = NULL,  // real-time processes stay on their hart
+  .pick_next = dl_pick_next,
+  .tick = dl_tick,
+  .set_prio = NULL,
+  .charge = dl_charge,
+  .steal = NULL,  // real-time processes stay on their hart
+};
+
+//
+// called when the running real-time process proc is being requeued, after it is
+// charged. if it used up its budget (preempted), or finished its job (yield), it is
+// moved to the throttled list until its next period, and 1 is returned. otherwise 0
+// is returned, and proc should be queued as usual.
+//
+int dl_throttle(run_queue *rq, process *proc, int preempted) {
+  if (preempted && proc->dl_budget > 0) return 0;
+
+  uint64 now = read_csr(time);
+  if (now >= proc->dl_next_period) {
+    // the next period has already begun.
+    dl_new_job(proc, now);
+    return 0;
+  }
+
+  if (preempted) proc->dl_overruns++;
+  proc->status = BLOCKED;
+  proc_queue_push(&rq->dl_throttled, proc);
+  return 1;
+}
+
+//
+// called on every timer tick: throttled processes whose next period has begun are
+// made runnable, and jobs past their deadline are counted as missed.
+//
+void dl_update(run_queue *rq) {
+  uint64 now = read_csr(time);
+
+  process *proc = rq->dl_throttled.head;
+  while (proc) {
+    process *next = proc->queue_next;
+    if (now >= proc->dl_next_period) {
+      dl_new_job(proc, proc->dl_next_period);
+      insert_to_ready_queue(proc);
+    }
+    proc = next;
+  }
+
+  if (current && current->dl_runtime && current->status == RUNNING &&
+      now > current->dl_abs_deadline) {
+    current->dl_misses++;
+    dl_new_job(current, now);
+  }
+
+  while (rq->dl_root && now > rq->dl_root->dl_abs_deadline) {
+    proc = dl_pop(rq);
+    proc->dl_misses++;
+    dl_new_job(proc, now);
+    dl_push(rq, proc);
+  }
+}
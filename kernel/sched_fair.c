@@ -0,0 +1,149 @@
+/*
+ * the proportional-share (CFS-like) scheduling class.
+ *
+ * every process has a virtual runtime, its running time scaled by NICE_0_WEIGHT over
+ * its weight, and the process with the smallest virtual runtime runs next. the weight
+ * follows the nice value, each step of nice changes the share by about 10%. runnable
+ * processes share a period of CFS_SCHED_LATENCY (stretched to CFS_MIN_GRANULARITY per
+ * process when there are many of them) in proportion to their weights.
+ */
+
+#include "sched.h"
+#include "spike_interface/spike_utils.h"
+
+// weights of nice -20 .. 19, as in Linux
+static const uint64 nice_to_weight[40] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+  9548,  7620,  6100,  4904,  3906,
+  3121,  2501,  1991,  1586,  1277,
+  1024,  820,   655,   526,   423,
+  335,   272,   215,   172,   137,
+  110,   87,    70,    56,    45,
+  36,    29,    23,    18,    15,
+};
+
+//
+// merge two skew heaps ordered by vruntime, returns the new root.
+//
+static process *cfs_merge(process *a, process *b) {
+  if (!a) return b;
+  if (!b) return a;
+  if (b->vruntime < a->vruntime) {
+    process *t = a;
+    a = b;
+    b = t;
+  }
+  process *t = a->rq_left;
+  a->rq_left = cfs_merge(a->rq_right, b);
+  a->rq_right = t;
+  return a;
+}
+
+static void cfs_enqueue(run_queue *rq, process *proc, int preempted) {
+  // a process that slept does not get more than CFS_SLEEPER_CREDIT ahead of others.
+  if (!preempted) {
+    uint64 floor = rq->min_vruntime > CFS_SLEEPER_CREDIT ?
+      rq->min_vruntime - CFS_SLEEPER_CREDIT : 0;
+    if (proc->vruntime < floor) proc->vruntime = floor;
+  }
+
+  proc->rq_left = proc->rq_right = NULL;
+  rq->cfs_root = cfs_merge(rq->cfs_root, proc);
+  rq->cfs_load += proc->cfs_weight;
+}
+
+//
+// the heap cannot unlink an inner node, so the smaller ones are popped until proc is
+// found and merged back. this is rare (cf. sched_setaffinity()), and queues are short.
+//
+static void cfs_dequeue(run_queue *rq, process *proc) {
+  process *popped = NULL;
+  while (rq->cfs_root != proc) {
+    process *top = rq->cfs_root;
+    rq->cfs_root = cfs_merge(top->rq_left, top->rq_right);
+    top->rq_left = top->rq_right = NULL;
+    popped = cfs_merge(popped, top);
+  }
+  rq->cfs_root = cfs_merge(cfs_merge(proc->rq_left, proc->rq_right), popped);
+  rq->cfs_load -= proc->cfs_weight;
+  proc->rq_left = proc->rq_right = NULL;
+}
+
+static process *cfs_pick_next(run_queue *rq) {
+  process *proc = rq->cfs_root;
+  if (!proc) panic("cfs: pick_next on an empty run queue.\n");
+
+  rq->cfs_root = cfs_merge(proc->rq_left, proc->rq_right);
+  rq->cfs_load -= proc->cfs_weight;
+  proc->rq_left = proc->rq_right = NULL;
+  proc->slice_start = proc->sum_exec;
+  return proc;
+}
+
+static void cfs_charge(run_queue *rq, process *proc, uint64 delta) {
+  proc->vruntime += delta * NICE_0_WEIGHT / proc->cfs_weight;
+
+  uint64 min = proc->vruntime;
+  if (rq->cfs_root && rq->cfs_root->vruntime < min) min = rq->cfs_root->vruntime;
+  if (min > rq->min_vruntime) rq->min_vruntime = min;
+}
+
+static int cfs_tick(run_queue *rq, process *proc) {
+  if (!rq->cfs_root) return 0;  // nobody to switch to
+
+  // the slice of proc is its share of the period by weight.
+  uint64 load = rq->cfs_load + proc->cfs_weight;
+  uint64 period = CFS_SCHED_LATENCY;
+  if (period < (rq->nr_running + 1) * CFS_MIN_GRANULARITY)
+    period = (rq->nr_running + 1) * CFS_MIN_GRANULARITY;
+  uint64 slice = period * proc->cfs_weight / load;
+
+  return proc->sum_exec - proc->slice_start >= slice;
+}
+
+//
+// the heap has no cheap way to the last process, the one to run next is taken. its
+// virtual runtime is carried over relative to the minimum of each queue.
+//
+static process *cfs_steal(run_queue *src, run_queue *dst, int allow_hot) {
+  process *proc = src->cfs_root;
+  if (!proc || !sched_can_migrate(proc, dst - g_rqs, allow_hot)) return NULL;
+
+  src->cfs_root = cfs_merge(proc->rq_left, proc->rq_right);
+  src->cfs_load -= proc->cfs_weight;
+  proc->rq_left = proc->rq_right = NULL;
+  // a woken process may lag behind the minimum (cf. cfs_enqueue()), which it keeps up to
+  // the sleeper credit on dst.
+  int64 lag = (int64)(proc->vruntime - src->min_vruntime);
+  int64 floor = (int64)dst->min_vruntime - CFS_SLEEPER_CREDIT;
+  int64 vruntime = (int64)dst->min_vruntime + lag;
+  if (vruntime < floor) vruntime = floor;
+  proc->vruntime = vruntime > 0 ? vruntime : 0;
+  return proc;
+}
+
+//
+// set the nice value of proc to prio.
+//
+static int cfs_set_prio(run_queue *rq, process *proc, int prio) {
+  if (prio < -20 || prio > 19) return -1;
+
+  uint64 weight = nice_to_weight[prio + 20];
+  // the heap is ordered by vruntime only, a queued process stays in place.
+  if (proc->on_rq) rq->cfs_load = rq->cfs_load - proc->cfs_weight + weight;
+  proc->nice = prio;
+  proc->cfs_weight = weight;
+  return 0;
+}
+
+const sched_class cfs_sched_class = {
+  .name = "cfs",
+  .enqueue = cfs_enqueue,
+  .dequeue = cfs_dequeue,
+  .pick_next = cfs_pick_next,
+  .tick = cfs_tick,
+  .set_prio = cfs_set_prio,
+  .charge = cfs_charge,
+  .steal = cfs_steal,
+};
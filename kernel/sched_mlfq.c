@@ -0,0 +1,115 @@
+/*
+ * the multi-level feedback queue scheduling class.
+ *
+ * a process enters at level 0. one that uses up the quantum of its level is moved one
+ * level down, one that gives up the processor before (yield, wait) is moved one level
+ * up. every MLFQ_BOOST_INTERVAL ticks all processes are moved back to level 0, so that
+ * no process starves. a process pinned to a level (cf. sys_user_setpriority) stays
+ * there. a running process is preempted as soon as a higher level becomes non-empty.
+ */
+
+#include "sched.h"
+#include "spike_interface/spike_utils.h"
+
+#define MLFQ_QUANTUM(level) (TIME_SLICE_LEN << (level))
+
+static void mlfq_enqueue(run_queue *rq, process *proc, int preempted) {
+  // gave up the processor before its quantum was used up.
+  if (!preempted && proc->mlfq_slice > 0) {
+    if (proc->mlfq_pin < 0 && proc->mlfq_level > 0) proc->mlfq_level--;
+    proc->mlfq_slice = 0;
+  }
+  proc_queue_push(&rq->level[proc->mlfq_level], proc);
+}
+
+static void mlfq_dequeue(run_queue *rq, process *proc) {
+  proc_queue_remove(&rq->level[proc->mlfq_level], proc);
+}
+
+static process *mlfq_pick_next(run_queue *rq) {
+  for (int l = 0; l < MLFQ_LEVELS; l++) {
+    process *proc = proc_queue_pop(&rq->level[l]);
+    if (!proc) continue;
+    if (proc->mlfq_slice <= 0) proc->mlfq_slice = MLFQ_QUANTUM(proc->mlfq_level);
+    return proc;
+  }
+  panic("mlfq: pick_next on an empty run queue.\n");
+  return NULL;
+}
+
+//
+// steal from the lowest level first, from the tail.
+//
+static process *mlfq_steal(run_queue *src, run_queue *dst, int allow_hot) {
+  for (int l = MLFQ_LEVELS - 1; l >= 0; l--)
+    for (process *proc = src->level[l].tail; proc; proc = proc->queue_prev)
+      if (sched_can_migrate(proc, dst - g_rqs, allow_hot)) {
+        proc_queue_remove(&src->level[l], proc);
+        return proc;
+      }
+  return NULL;
+}
+
+//
+// move every process that is not pinned back to level 0.
+//
+static void mlfq_boost(run_queue *rq, process *running) {
+  for (int l = 1; l < MLFQ_LEVELS; l++) {
+    process *proc = rq->level[l].head;
+    while (proc) {
+      process *next = proc->queue_next;
+      if (proc->mlfq_pin < 0) {
+        proc_queue_remove(&rq->level[l], proc);
+        proc->mlfq_level = 0;
+        proc->mlfq_slice = 0;
+        proc_queue_push(&rq->level[0], proc);
+      }
+      proc = next;
+    }
+  }
+  if (running->mlfq_pin < 0) running->mlfq_level = 0;
+}
+
+static int mlfq_tick(run_queue *rq, process *proc) {
+  if (rq->ticks % MLFQ_BOOST_INTERVAL == 0) mlfq_boost(rq, proc);
+
+  if (--proc->mlfq_slice <= 0) {
+    // used up its quantum.
+    if (proc->mlfq_pin < 0 && proc->mlfq_level < MLFQ_LEVELS - 1) proc->mlfq_level++;
+    proc->mlfq_slice = 0;
+    return 1;
+  }
+
+  // a process of a higher level is waiting.
+  for (int l = 0; l < proc->mlfq_level; l++)
+    if (rq->level[l].head) return 1;
+  return 0;
+}
+
+//
+// pin proc to level prio, or unpin it if prio is -1.
+//
+static int mlfq_set_prio(run_queue *rq, process *proc, int prio) {
+  if (prio < -1 || prio >= MLFQ_LEVELS) return -1;
+  proc->mlfq_pin = prio;
+  if (prio < 0) return 0;
+
+  if (proc->on_rq && proc->mlfq_level != prio) {
+    proc_queue_remove(&rq->level[proc->mlfq_level], proc);
+    proc_queue_push(&rq->level[prio], proc);
+  }
+  proc->mlfq_level = prio;
+  proc->mlfq_slice = 0;
+  return 0;
+}
+
+const sched_class mlfq_sched_class = {
+  .name = "mlfq",
+  .enqueue = mlfq_enqueue,
+  .dequeue = mlfq_dequeue,
+  .pick_next = mlfq_pick_next,
+  .tick = mlfq_tick,
+  .set_prio = mlfq_set_prio,
+  .charge = NULL,
+  .steal = mlfq_steal,
+};
@@ -0,0 +1,76 @@
+/*
+ * multi-hart support: hart bring-up, the big kernel lock and inter-processor interrupts.
+ */
+
+#include "smp.h"
+#include "sbi.h"
+#include "spike_interface/atomic.h"
+
+volatile int g_ncpu = 0;
+volatile int g_cpu_online[NCPU];
+volatile int g_timer_pending[NCPU];
+// whether each hart runs in user mode, and how many times it entered the kernel (which
+// flushes its TLB)
+static volatile int g_cpu_in_user[NCPU];
+static volatile uint64 g_cpu_entries[NCPU];
+
+static spinlock_t g_kernel_lock = SPINLOCK_INIT;
+
+void kernel_lock() { spinlock_lock(&g_kernel_lock); }
+
+void kernel_unlock() { spinlock_unlock(&g_kernel_lock); }
+
+//
+// mark hart "hartid" as running the kernel.
+//
+void smp_cpu_up(int hartid) {
+  g_cpu_online[hartid] = 1;
+  atomic_add(&g_ncpu, 1);
+}
+
+//
+// wake hart "hartid" up, e.g., from the wfi in its idle loop.
+//
+void smp_send_ipi(int hartid) {
+  sbi_call(SBI_SEND_IPI, hartid);
+}
+
+//
+// acknowledge the S-mode soft interrupt of this hart. returns non-zero if it brought a
+// timer tick, and zero if it was only an inter-processor interrupt.
+//
+int smp_ack_softirq() {
+  // clear the interrupt first: a tick arriving meanwhile raises it again.
+  write_csr(sip, read_csr(sip) & ~SIP_SSIP);
+  return atomic_swap(&g_timer_pending[cpuid()], 0);
+}
+
+void smp_enter_kernel() {
+  g_cpu_in_user[cpuid()] = 0;
+  g_cpu_entries[cpuid()]++;
+  mb();
+}
+
+void smp_leave_kernel() {
+  g_cpu_in_user[cpuid()] = 1;
+  mb();
+}
+
+//
+// a hart in the kernel flushed its TLB on the way in, and flushes it again on its way
+// out. a hart in user mode is interrupted, and has flushed once it entered the kernel
+// for it. it cannot be waiting for the kernel lock before that, so we wait with the lock
+// held.
+//
+void smp_flush_tlb(uint64 mask) {
+  uint64 seen[NCPU];
+  for (int i = 0; i < NCPU; i++) {
+    if (!(mask & (1UL << i))) continue;
+    seen[i] = g_cpu_entries[i];
+    if (g_cpu_in_user[i]) smp_send_ipi(i);
+    else mask &= ~(1UL << i);
+  }
+  for (int i = 0; i < NCPU; i++)
+    if (mask & (1UL << i))
+      while (g_cpu_in_user[i] && g_cpu_entries[i] == seen[i]) ;
+}
@@ -0,0 +1,40 @@
+#ifndef _SMP_H_
+#define _SMP_H_
+
+#include "util/types.h"
+#include "config.h"
+#include "riscv.h"
+
+// the id of the hart running the code. in S-mode, tp always holds the hart id: it is
+// set in s_start(), and reloaded from the trapframe on every trap from user mode
+// (cf. kernel/strap_vector.S).
+#define cpuid() ((int)read_tp())
+
+// number of harts running the kernel, and which of them are up
+extern volatile int g_ncpu;
+extern volatile int g_cpu_online[NCPU];
+
+// the big kernel lock. a hart holds it from the moment it enters the kernel until it
+// returns to user mode (cf. switch_to() in kernel/process.c), so all kernel data is
+// accessed by one hart at a time. it stays held across switches between kernel
+// contexts (cf. schedule() in kernel/sched.c).
+void kernel_lock();
+void kernel_unlock();
+
+void smp_cpu_up(int hartid);
+
+// set by the M-mode timer handler of each hart, along with the S-mode soft interrupt
+// which is also used for inter-processor interrupts.
+extern volatile int g_timer_pending[NCPU];
+
+void smp_send_ipi(int hartid);
+int smp_ack_softirq();
+
+// a hart enters the kernel from user mode, with its TLB flushed (cf. kernel/strap_vector.S),
+// or leaves it for user mode.
+void smp_enter_kernel();
+void smp_leave_kernel();
+// make the harts in "mask" drop their TLB entries of user mappings, and wait until they did
+void smp_flush_tlb(uint64 mask);
+
+#endif
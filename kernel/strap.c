@@ -9,6 +9,11 @@
 #include "pmm.h"
 #include "vmm.h"
 #include "sched.h"
+#include "wss.h"
+#include "ksm.h"
+#include "zram.h"
+#include "sbi.h"
+#include "fpu.h"
 #include "util/functions.h"
 #include "memlayout.h"
 
@@ -29,13 +34,114 @@ static void handle_syscall(trapframe *tf) {
 //
 // global variable that store the recorded "ticks". added @lab1_3
 static uint64 g_ticks = 0;
+
+#if TIMER_TICKLESS
+// the time the timer of each hart is set to fire at, -1 if it is off
+static volatile uint64 g_timer_event[NCPU];
+#endif
 //
 // added @lab1_3
 //
 void handle_mtimer_trap() {
-  sprint("Ticks %d\n", g_ticks);
-  g_ticks ++;
   write_csr(sip, read_csr(sip) & (~SIP_SSIP));
+  uint64 now = read_csr(time);
+
+#if TIMER_TICKLESS
+  // the timer fired, and stays off until set again (cf. program_timer()).
+  g_timer_event[cpuid()] = -1UL;
+#endif
+
+  // whichever hart takes a tick runs the kernel timers that expired.
+  timer_run(now);
+
+  // every hart gets its own timer interrupts, which only drive its scheduler (cf.
+  // rrsched()). the system-wide ticks and the scanners below are driven by hart 0.
+  if (cpuid() != 0) return;
+#if TIMER_TICKLESS
+  // ticks come only when needed, so they are derived from the time.
+  uint64 ticks = now / TIMER_INTERVAL;
+#else
+  sprint("Ticks %d\n", g_ticks);
+  uint64 ticks = g_ticks + 1;
+#endif
+
+  // sample the working sets of all processes.
+  if (ticks / WSS_SCAN_INTERVAL != g_ticks / WSS_SCAN_INTERVAL) wss_scan();
+  // merge identical pages of mergeable processes.
+  if (ticks / KSM_SCAN_INTERVAL != g_ticks / KSM_SCAN_INTERVAL) ksm_scan();
+  g_ticks = ticks;
+}
+
+//
+// Sstc: the timer of this hart fired. STIP stays pending until stimecmp is set again,
+// to the next tick (or, in tickless mode, off until program_timer() sets it).
+//
+static void stimer_ack() {
+#if TIMER_TICKLESS
+  write_stimecmp(-1UL);
+#else
+  write_stimecmp(read_stimecmp() + TIMER_INTERVAL);
+#endif
+}
+
+//
+// acknowledge the timer interrupts pending on this hart, for an idle hart that took
+// no trap for them. returns non-zero if there was a tick.
+//
+int ack_timer_irq() {
+  int tick = smp_ack_softirq();
+  if (g_sstc && (read_csr(sip) & SIP_STIP)) {
+    stimer_ack();
+    tick = 1;
+  }
+  return tick;
+}
+
+#if TIMER_TICKLESS
+//
+// the next run of the scanners driven by hart 0, -1 if there is no process to scan.
+//
+static uint64 next_scan() {
+  if (g_nr_live == 0) return -1UL;
+
+  uint64 wss = (g_ticks / WSS_SCAN_INTERVAL + 1) * WSS_SCAN_INTERVAL;
+  uint64 ksm = (g_ticks / KSM_SCAN_INTERVAL + 1) * KSM_SCAN_INTERVAL;
+  return MIN(wss, ksm) * TIMER_INTERVAL;
+}
+#endif
+
+//
+// tickless mode: set the timer of this hart to the next event it has to handle. that is
+// the next scheduler tick, if its process has to share the hart. hart 0 also handles
+// the kernel timers and the scanners. called before returning to user mode, and before
+// an idle hart goes to sleep.
+//
+void program_timer() {
+#if TIMER_TICKLESS
+  uint64 next = sched_next_tick(read_csr(time));
+  if (cpuid() == 0) {
+    next = MIN(next, timer_next_expiry());
+    next = MIN(next, next_scan());
+  }
+
+  if (next != g_timer_event[cpuid()]) {
+    // with Sstc, without a trap to M-mode.
+    if (g_sstc)
+      write_stimecmp(next);
+    else
+      sbi_call(SBI_SET_TIMER, next);
+    g_timer_event[cpuid()] = next;
+  }
+#endif
+}
+
+//
+// a kernel timer was set to expire at "when": make sure hart 0 wakes up for it.
+//
+void timer_event_added(uint64 when) {
+#if TIMER_TICKLESS
+  if (cpuid() != 0 && when < g_timer_event[0]) smp_send_ipi(0);
+#endif
 }
 
 //
@@ -44,6 +150,23 @@ void handle_mtimer_trap() {
 // stval: the virtual address that causes pagefault when being accessed.
 //
 void handle_user_page_fault(uint64 mcause, uint64 sepc, uint64 stval) {
+  // a page in the compressed store is decompressed into a new frame.
+  int r = zram_swapin(current->pagetable, stval);
+  if (r < 0) panic("out of memory when decompressing the page at %lx.\n", stval);
+  if (r > 0) return;
+
+  // a write to a page merged by kernel/ksm.c gets a private copy.
+  if (mcause == CAUSE_STORE_PAGE_FAULT) {
+    r = user_vm_break_cow(current->pagetable, stval);
+    if (r < 0) panic("out of memory when copying a shared page at %lx.\n", stval);
+    if (r > 0) return;
+  }
+
+  // faults taken only to set the accessed/dirty bits of a mapped page are resolved
+  // silently (cf. user_vm_fixup_ad() in kernel/vmm.c).
+  if (user_vm_fixup_ad(current->pagetable, stval, mcause == CAUSE_STORE_PAGE_FAULT))
+    return;
+
   sprint("handle_page_fault: %lx\n", stval);
   switch (mcause) {
     case CAUSE_STORE_PAGE_FAULT:
@@ -51,9 +174,17 @@ void handle_user_page_fault(uint64 mcause, uint64 sepc, uint64 stval) {
       // dynamically increase application stack.
       // hint: first allocate a new physical page, and then, maps the new page to the
       // virtual address that causes the page fault.
-      if(stval < USER_STACK_TOP && stval > (USER_STACK_TOP - 20 * STACK_SIZE)) {
-        void* pa = alloc_page();
-        user_vm_map(current->pagetable, stval / (PGSIZE) * (PGSIZE), PGSIZE, (uint64)(pa), prot_to_type(PROT_WRITE | PROT_READ, 1));
+      if(stval < USER_STACK_TOP && stval > (USER_STACK_TOP - USER_STACK_PAGES * STACK_SIZE)) {
+        // a stack that cannot grow within the memory limit terminates the process.
+        void* pa = NULL;
+        if (mm_try_charge(current, MM_RSS, 1) == 0 && (pa = alloc_page()) == NULL)
+          mm_uncharge(current, MM_RSS, 1);
+        if (pa == NULL) {
+          sprint("process %d is out of memory, cannot grow its stack.\n", current->pid);
+          do_exit(-1);
+        }
+        mm_charge(current, MM_PAGETABLE, user_vm_map(current->pagetable,
+          stval / (PGSIZE) * (PGSIZE), PGSIZE, (uint64)(pa), prot_to_type(PROT_WRITE | PROT_READ, 1)));
       }
       break;
     default:
@@ -70,14 +201,21 @@ void rrsched() {
   // hint: increase the tick_count member of current process by one, if it is bigger than
   // TIME_SLICE_LEN (means it has consumed its time slice), change its status into READY,
   // place it in the rear of ready queue, and finally schedule next process to run.
-  if(current->tick_count + 1 >= TIME_SLICE_LEN){
-    current->tick_count = 0;
-    insert_to_ready_queue(current);
-    schedule();
-  }
-  else{
-    current->tick_count++;
-  }
+  // the length of the time slice is decided by the scheduling class (kernel/sched.c).
+#if TIMER_TICKLESS
+  // the interrupt may have come only for a kernel timer or the scanners.
+  if (!sched_tick_due(read_csr(time))) return;
+#endif
+  if (sched_tick()) sched_preempt();
+}
+
+//
+// a trap taken by the kernel itself (cf. kernel/kernel_vector.S) is fatal.
+//
+void kernel_trap_handler(void) {
+  if (read_csr(scause) == CAUSE_ILLEGAL_INSTRUCTION) panic("Illegal instruction!");
+  panic("kernel trap: scause %p, sepc %p, stval %p\n", read_csr(scause), read_csr(sepc),
+    read_csr(stval));
 }
 
 //
@@ -85,10 +223,19 @@ void rrsched() {
 // in S-mode.
 //
 void smode_trap_handler(void) {
+  // traps taken from now on, until switch_to() returns to user mode, come from the
+  // kernel, and have no user context to save.
+  write_csr(stvec, (uint64)kernel_trap_vector);
+
   // make sure we are in User mode before entering the trap handling.
   // we will consider other previous case in lab1_3 (interrupt).
   if ((read_csr(sstatus) & SSTATUS_SPP) != 0) panic("usertrap: not from user mode");
 
+  // enter the kernel, released when going back to user mode in switch_to(). a hart
+  // waiting for our TLB flush (cf. smp_flush_tlb()) may hold the lock meanwhile.
+  smp_enter_kernel();
+  kernel_lock();
+
   assert(current);
   // save user process counter.
   current->trapframe->epc = read_csr(sepc);
@@ -103,12 +250,26 @@ void smode_trap_handler(void) {
       handle_syscall(current->trapframe);
       break;
     case CAUSE_MTIMER_S_TRAP:
+      // an inter-processor interrupt only wakes the hart up (cf. smp_send_ipi()).
+      if (!smp_ack_softirq()) break;
       handle_mtimer_trap();
       // invoke round-robin scheduler. added @lab3_3
       rrsched();
       break;
+    case CAUSE_STIMER_S_TRAP:
+      // Sstc: the timer interrupt comes to S-mode directly.
+      stimer_ack();
+      handle_mtimer_trap();
+      rrsched();
+      break;
+    case CAUSE_ILLEGAL_INSTRUCTION:
+      // the first FP instruction since the process got the hart loads its FP state,
+      // and is executed again (cf. kernel/fpu.c).
+      if (!fpu_trap(current)) panic("Illegal instruction!");
+      break;
     case CAUSE_STORE_PAGE_FAULT:
     case CAUSE_LOAD_PAGE_FAULT:
+    case CAUSE_FETCH_PAGE_FAULT:
       // the address of missing page is stored in stval
       // call handle_user_page_fault to process page faults
       handle_user_page_fault(cause, read_csr(sepc), read_csr(stval));
@@ -120,6 +281,9 @@ void smode_trap_handler(void) {
       break;
   }
 
+  // a process killed meanwhile (cf. alarm_expired() in kernel/timer.c) exits here.
+  if (current->killed) do_exit(-1);
+
   // continue (come back to) the execution of current process.
   switch_to(current);
 }
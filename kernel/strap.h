@@ -1,6 +1,15 @@
 #ifndef _STRAP_H_
 #define _STRAP_H_
 
+#include "util/types.h"
+
 void smode_trap_handler(void);
+// the trap vector while a hart runs the kernel (kernel/kernel_vector.S), and its handler
+void kernel_trap_vector(void);
+void kernel_trap_handler(void);
+void handle_mtimer_trap();
+void program_timer();
+int ack_timer_irq();
+void timer_event_added(uint64 when);
 
 #endif
@@ -13,6 +13,8 @@
 #include "pmm.h"
 #include "vmm.h"
 #include "sched.h"
+#include "zram.h"
+#include "futex.h"
 
 #include "spike_interface/spike_utils.h"
 
@@ -34,27 +36,7 @@ ssize_t sys_user_print(const char* buf, size_t n) {
 ssize_t sys_user_exit(uint64 code) {
   sprint("User exit with code:%d.\n", code);
   // reclaim the current process, and reschedule. added @lab3_1
-  free_process( current );
-  if (current->parent == NULL)
-  {
-    schedule();
-    return 0;
-  }
-  process *pre = NULL;
-  process *cur = blocked_queue_head;
-  while (cur)
-  {
-    if (cur->waiting == current)
-    {
-      if(pre) pre->queue_next = cur->queue_next;
-      insert_to_ready_queue(cur);
-      schedule();
-      return 0;
-    }
-    pre = cur;
-    cur = cur->queue_next;
-  }
-  schedule();
+  do_exit(code);
   return 0;
 }
 
@@ -62,11 +44,18 @@ ssize_t sys_user_exit(uint64 code) {
 // maybe, the simplest implementation of malloc in the world ... added @lab2_2
 //
 uint64 sys_user_allocate_page() {
+  // fail (returning NULL) instead of taking the process over its memory limit.
+  if (mm_try_charge(current, MM_RSS, 1) < 0) return 0;
   void* pa = alloc_page();
+  if (pa == NULL) {
+    mm_uncharge(current, MM_RSS, 1);
+    return 0;
+  }
+
   uint64 va = g_ufree_page;
   g_ufree_page += PGSIZE;
-  user_vm_map((pagetable_t)current->pagetable, va, PGSIZE, (uint64)pa,
-         prot_to_type(PROT_WRITE | PROT_READ, 1));
+  mm_charge(current, MM_PAGETABLE, user_vm_map((pagetable_t)current->pagetable, va, PGSIZE,
+         (uint64)pa, prot_to_type(PROT_WRITE | PROT_READ, 1)));
 
   return va;
 }
@@ -75,7 +64,15 @@ uint64 sys_user_allocate_page() {
 // reclaim a page, indicated by "va". added @lab2_2
 //
 uint64 sys_user_free_page(uint64 va) {
-  user_vm_unmap((pagetable_t)current->pagetable, va, PGSIZE, 1);
+  pagetable_t pt = (pagetable_t)current->pagetable;
+  pte_t *pte = va < MAXVA ? page_walk(pt, va, 0) : NULL;
+  void *pa = (pte && (*pte & PTE_V)) ? (void *)PTE2PA(*pte) : NULL;
+
+  // the page is dropped only once the other threads cannot reach it through their TLB.
+  int nr_unmapped = user_vm_unmap(pt, va, PGSIZE, 0);
+  tlb_shootdown(current);
+  if (pa) put_page(pa);
+  mm_uncharge(current, MM_RSS, nr_unmapped);
   return 0;
 }
 
@@ -87,6 +84,72 @@ ssize_t sys_user_fork() {
   return do_fork( current );
 }
 
+//
+// copy the path name at user address "upath" into buf, of MAX_PATH_LEN bytes. returns -1
+// if it is not mapped, or too long.
+//
+static int copy_path(char *buf, const char *upath) {
+  for (int i = 0; i < MAX_PATH_LEN; i++) {
+    char *pa = (char *)user_va_to_pa((pagetable_t)(current->pagetable), (void *)(upath + i));
+    if (pa == NULL) return -1;
+    if ((buf[i] = *pa) == 0) return 0;
+  }
+  return -1;
+}
+
+//
+// replace the program of the caller by the one at "path" on the host. does not return
+// on success (the syscall returns 0 to the new program), returns -1 otherwise.
+//
+ssize_t sys_user_exec(const char *upath) {
+  char path[MAX_PATH_LEN];
+  if (copy_path(path, upath) < 0) return -1;
+  return do_exec(current, path);
+}
+
+//
+// start the program at "path" on the host in a new child process. returns its pid.
+//
+ssize_t sys_user_spawn(const char *upath) {
+  char path[MAX_PATH_LEN];
+  if (copy_path(path, upath) < 0) return -1;
+  return do_spawn(current, path);
+}
+
+//
+// create a child that runs in the address space of the caller, which is blocked until the
+// child execs or exits. returns the pid of the child to the caller, and 0 to the child.
+//
+ssize_t sys_user_vfork() {
+  return do_vfork(current);
+}
+
+//
+// create a thread of the caller, sharing its address space, that starts at "entry" with
+// arg0 and arg1 as arguments. the caller collects its exit by wait(). returns its pid.
+//
+ssize_t sys_user_clone(uint64 entry, uint64 arg0, uint64 arg1) {
+  return do_clone(current, entry, arg0, arg1);
+}
+
+//
+// FUTEX_WAIT: block while the int at uaddr holds val, for at most timeout_ns nanoseconds
+// (0 for no limit). returns 0 once woken up, -1 if the int did not hold val or the time
+// ran out. FUTEX_WAKE: wake up to val processes waiting on uaddr, returns their number.
+//
+ssize_t sys_user_futex(uint64 uaddr, int op, int val, uint64 timeout_ns) {
+  switch (op) {
+    case FUTEX_WAIT:
+      // rounded up, as 0 stands for no limit.
+      return futex_wait(uaddr, val,
+        (timeout_ns + (1000000000 / TIMEBASE_FREQ) - 1) / (1000000000 / TIMEBASE_FREQ));
+    case FUTEX_WAKE:
+      return futex_wake(uaddr, val);
+    default:
+      return -1;
+  }
+}
+
 //
 // kerenl entry point of yield. added @lab3_2
 //
@@ -95,39 +158,164 @@ ssize_t sys_user_yield() {
   // hint: the functionality of yield is to give up the processor. therefore,
   // we should set the status of currently running process to READY, insert it in
   // the rear of ready queue, and finally, schedule a READY process to run.
-  current->status = READY;
   insert_to_ready_queue(current);
   schedule();
   return 0;
 }
 
+//
+// the child "pid" of the caller, or for -1 any child, that has exited. *found is set to
+// zero if the caller has no such child at all.
+//
+static process *zombie_child(int pid, int *found) {
+  process *zombie = NULL;
+  *found = 0;
+  for (process *child = current->first_child; child; child = child->sibling_next) {
+    if (pid != -1 && child->pid != pid) continue;
+    *found = 1;
+    if (child->status == ZOMBIE) zombie = child;
+  }
+  return zombie;
+}
+
 ssize_t sys_user_wait(int pid)
 {
-  process *child = NULL;
-
-  if (pid >= -1)
-  {
-    int temp_pid = 0;
-    for (int i = 0; i < NPROC; i++)
-    if(procs[i].parent == current && (pid == -1 || pid == procs[i].pid)) {
-      temp_pid = procs[i].pid;
-      if (procs[i].status != ZOMBIE)
-        child = &procs[i];
-      if(pid >= 0) break;
-    }
-    if (child)
-    {
-      current->status = BLOCKED;
-      current->waiting = child;
-      insert_to_blocked_queue(current);
-      schedule();
-      return child->pid;
-    }
-    if(pid == -1)
-      return temp_pid;
-  }
+  process *zombie;
+  int found;
 
-  return -1;
+  // until such a child exits. each exiting child wakes us up to look again.
+  wait_event(&current->child_wq, (zombie = zombie_child(pid, &found)) != NULL || !found);
+  if (zombie == NULL) return -1;
+
+  int ret = zombie->pid;
+  release_process(zombie);
+  return ret;
+}
+
+//
+// report the memory statistics of process "pid" (or the caller, if pid is -1) into the
+// user buffer "st".
+//
+ssize_t sys_user_memstat(int pid, mem_stat *st) {
+  process *p = (pid == -1) ? current : NULL;
+  if (pid >= 0) p = find_process(pid);
+  if (p == NULL) return -1;
+  // the memory of a thread is that of its leader.
+  p = p->leader;
+
+  mem_stat ms;
+  ms.rss = p->wss_rss;
+  ms.wss = p->wss_pages;
+  ms.dirty = p->wss_dirty;
+  ms.wss_peak = p->wss_peak;
+  ms.scans = p->wss_scans;
+  ms.interval = WSS_SCAN_INTERVAL;
+  ms.charged_rss = p->mm_rss;
+  ms.pt_pages = p->mm_pt_pages;
+  ms.kobj_pages = p->mm_kobj_pages;
+  ms.soft_limit = p->mm_soft_limit;
+  ms.hard_limit = p->mm_hard_limit;
+  // the buffer may sit in a page shared by kernel/ksm.c, or span two pages.
+  return user_vm_copyout(current->pagetable, (uint64)st, &ms, sizeof(ms));
+}
+
+//
+// set the soft and hard memory limits (in pages, 0 for none) of the calling process.
+// the limits are inherited by children forked afterwards.
+//
+ssize_t sys_user_set_memlimit(uint64 soft, uint64 hard) {
+  if (hard && soft > hard) return -1;
+  current->leader->mm_soft_limit = soft;
+  current->leader->mm_hard_limit = hard;
+  return 0;
+}
+
+//
+// set the scheduling priority of process "pid" (or the caller, if pid is -1). with the
+// MLFQ scheduler, prio pins the process to that level (0 is the highest), -1 unpins it.
+// with the CFS scheduler, prio is the nice value (-20 .. 19).
+//
+ssize_t sys_user_setpriority(int pid, int prio) {
+  process *p = (pid == -1) ? current : NULL;
+  if (pid >= 0) p = find_process(pid);
+  if (p == NULL || p->status == ZOMBIE) return -1;
+  return sched_set_prio(p, prio);
+}
+
+//
+// make the caller a real-time (EDF) process: every "period" it may run for "runtime",
+// finishing within "deadline" from the start of the period. all in mtime units, with
+// runtime <= deadline <= period. runtime 0 makes it a normal process again. fails if
+// the real-time processes would use more than DL_BW_LIMIT percent of the processor.
+//
+ssize_t sys_user_sched_setattr(uint64 runtime, uint64 deadline, uint64 period) {
+  return sched_setattr(current, runtime, deadline, period);
+}
+
+//
+// restrict process "pid" (or the caller, if pid is -1) to the harts whose bits are set
+// in "mask". children forked afterwards inherit the mask.
+//
+ssize_t sys_user_sched_setaffinity(int pid, uint64 mask) {
+  process *p = (pid == -1) ? current : NULL;
+  if (pid >= 0) p = find_process(pid);
+  if (p == NULL || p->status == ZOMBIE) return -1;
+  return sched_setaffinity(p, mask);
+}
+
+//
+// report the scheduling statistics of process "pid" (or the caller, if pid is -1) into
+// the user buffer "st".
+//
+ssize_t sys_user_sched_stat(int pid, sched_stat *st) {
+  process *p = (pid == -1) ? current : NULL;
+  if (pid >= 0) p = find_process(pid);
+  if (p == NULL) return -1;
+
+  sched_stat ss;
+  ss.sum_exec = p->sum_exec;
+  ss.dl_runtime = p->dl_runtime;
+  ss.dl_deadline = p->dl_deadline;
+  ss.dl_period = p->dl_period;
+  ss.dl_jobs = p->dl_jobs;
+  ss.dl_misses = p->dl_misses;
+  ss.dl_overruns = p->dl_overruns;
+  ss.dl_bw = sched_dl_bw(p);
+  ss.cpu = p->cpu;
+  ss.cpu_mask = p->cpu_mask;
+  return user_vm_copyout(current->pagetable, (uint64)st, &ss, sizeof(ss));
+}
+
+//
+// block the caller for (at least) "ns" nanoseconds.
+//
+ssize_t sys_user_nanosleep(uint64 ns) {
+  timer_sleep(ns / (1000000000 / TIMEBASE_FREQ));
+  return 0;
+}
+
+//
+// terminate the caller in "seconds" seconds, 0 to cancel a pending alarm. returns the
+// seconds that were left of the previous alarm, rounded up.
+//
+ssize_t sys_user_alarm(uint64 seconds) {
+  uint64 left = timer_alarm(current, seconds * TIMEBASE_FREQ);
+  return (left + TIMEBASE_FREQ - 1) / TIMEBASE_FREQ;
+}
+
+//
+// allow (or disallow) kernel/ksm.c to merge the pages of the calling process.
+//
+ssize_t sys_user_set_mergeable(int enable) {
+  current->leader->ksm_mergeable = (enable != 0);
+  return 0;
+}
+
+//
+// report the statistics of the compressed page store into the user buffer "st".
+//
+ssize_t sys_user_zram_stat(zram_stat *st) {
+  return user_vm_copyout(current->pagetable, (uint64)st, &g_zram_stat, sizeof(g_zram_stat));
 }
 
 //
@@ -151,6 +339,36 @@ long do_syscall(long a0, long a1, long a2, long a3, long a4, long a5, long a6, l
       return sys_user_yield();
     case SYS_user_wait:
       return sys_user_wait(a1);
+    case SYS_user_memstat:
+      return sys_user_memstat(a1, (mem_stat *)a2);
+    case SYS_user_set_mergeable:
+      return sys_user_set_mergeable(a1);
+    case SYS_user_zram_stat:
+      return sys_user_zram_stat((zram_stat *)a1);
+    case SYS_user_set_memlimit:
+      return sys_user_set_memlimit(a1, a2);
+    case SYS_user_setpriority:
+      return sys_user_setpriority(a1, a2);
+    case SYS_user_sched_setattr:
+      return sys_user_sched_setattr(a1, a2, a3);
+    case SYS_user_sched_stat:
+      return sys_user_sched_stat(a1, (sched_stat *)a2);
+    case SYS_user_sched_setaffinity:
+      return sys_user_sched_setaffinity(a1, a2);
+    case SYS_user_nanosleep:
+      return sys_user_nanosleep(a1);
+    case SYS_user_alarm:
+      return sys_user_alarm(a1);
+    case SYS_user_clone:
+      return sys_user_clone(a1, a2, a3);
+    case SYS_user_futex:
+      return sys_user_futex(a1, a2, a3, a4);
+    case SYS_user_exec:
+      return sys_user_exec((const char *)a1);
+    case SYS_user_spawn:
+      return sys_user_spawn((const char *)a1);
+    case SYS_user_vfork:
+      return sys_user_vfork();
     default:
       panic("Unknown syscall %ld \n", a0);
   }
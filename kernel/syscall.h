@@ -15,6 +15,73 @@
 #define SYS_user_fork (SYS_user_base + 4)
 #define SYS_user_yield (SYS_user_base + 5)
 #define SYS_user_wait (SYS_user_base + 6)
+#define SYS_user_memstat (SYS_user_base + 7)
+#define SYS_user_set_mergeable (SYS_user_base + 8)
+#define SYS_user_zram_stat (SYS_user_base + 9)
+#define SYS_user_set_memlimit (SYS_user_base + 10)
+#define SYS_user_setpriority (SYS_user_base + 11)
+#define SYS_user_sched_setattr (SYS_user_base + 12)
+#define SYS_user_sched_stat (SYS_user_base + 13)
+#define SYS_user_sched_setaffinity (SYS_user_base + 14)
+#define SYS_user_nanosleep (SYS_user_base + 15)
+#define SYS_user_alarm (SYS_user_base + 16)
+#define SYS_user_clone (SYS_user_base + 17)
+#define SYS_user_futex (SYS_user_base + 18)
+#define SYS_user_exec (SYS_user_base + 19)
+#define SYS_user_spawn (SYS_user_base + 20)
+#define SYS_user_vfork (SYS_user_base + 21)
+
+// longest path name (with its terminating 0) taken by SYS_user_exec and SYS_user_spawn
+#define MAX_PATH_LEN 256
+
+// operations of SYS_user_futex
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+// per-process memory statistics, reported by SYS_user_memstat
+typedef struct mem_stat_t {
+  uint64 rss;       // resident user pages
+  uint64 wss;       // pages accessed during the last scan interval
+  uint64 dirty;     // pages written during the last scan interval
+  uint64 wss_peak;  // largest working set observed so far
+  uint64 scans;     // number of completed scans
+  uint64 interval;  // length of a scan interval, in timer ticks
+  // memory charged to the process, in pages, and its limits (0 for none)
+  uint64 charged_rss;
+  uint64 pt_pages;
+  uint64 kobj_pages;
+  uint64 soft_limit;
+  uint64 hard_limit;
+} mem_stat;
+
+// scheduling statistics of a process, reported by SYS_user_sched_stat. times are in
+// mtime units.
+typedef struct sched_stat_t {
+  uint64 sum_exec;     // total running time
+  // real-time parameters, all 0 if the process is not real-time
+  uint64 dl_runtime;
+  uint64 dl_deadline;
+  uint64 dl_period;
+  uint64 dl_jobs;      // jobs started
+  uint64 dl_misses;    // jobs unfinished at their deadline
+  uint64 dl_overruns;  // jobs that used up their runtime
+  uint64 dl_bw;        // utilization admitted on the hart of the process, per mille
+  int64 cpu;           // hart the process runs (or last ran) on, -1 if none yet
+  uint64 cpu_mask;     // harts the process may run on
+} sched_stat;
+
+// statistics of the compressed page store, reported by SYS_user_zram_stat
+typedef struct zram_stat_t {
+  uint64 stored;       // pages currently held compressed
+  uint64 orig_bytes;   // uncompressed size of the stored pages
+  uint64 comp_bytes;   // compressed size of the stored pages
+  uint64 pool_pages;   // physical pages used by the store
+  uint64 nr_stores;    // pages compressed so far
+  uint64 nr_loads;     // pages decompressed so far
+  uint64 nr_rejects;   // cold pages that did not compress well enough
+  uint64 store_cycles; // cycles spent compressing
+  uint64 load_cycles;  // cycles spent decompressing
+} zram_stat;
 
 long do_syscall(long a0, long a1, long a2, long a3, long a4, long a5, long a6, long a7);
 
@@ -0,0 +1,213 @@
+/*
+ * Kernel timers, kept in a hierarchical timing wheel.
+ *
+ * The wheel counts time in units of TIMER_WHEEL_RES. It has TW_LEVELS levels of
+ * TW_SIZE slots each: a slot of level 0 holds the timers expiring in one unit, a slot
+ * of level l those expiring in a span of TW_SIZE^l units. A timer is placed in the
+ * lowest level whose span of TW_SIZE slots still reaches its expiry, so adding and
+ * cancelling a timer are O(1). Whenever the wheel time enters a new round of a level,
+ * the timers of the next slot of the level above are cascaded down into it.
+ */
+
+#include "timer.h"
+#include "process.h"
+#include "sched.h"
+#include "config.h"
+#include "riscv.h"
+#include "strap.h"
+#include "spike_interface/spike_utils.h"
+
+#define TW_BITS 6
+#define TW_SIZE (1 << TW_BITS)
+#define TW_MASK (TW_SIZE - 1)
+#define TW_LEVELS 4
+// timers further in the future wait in the last level, and are cascaded again
+#define TW_MAX_DELTA ((1UL << (TW_BITS * TW_LEVELS)) - 1)
+
+static timer *g_wheel[TW_LEVELS][TW_SIZE];
+// the wheel time: all timers expiring before it have run.
+static uint64 g_wheel_time = 0;
+static int g_nr_timers = 0;
+
+static void slot_insert(timer **slot, timer *t) {
+  t->next = *slot;
+  if (t->next) t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+static void slot_remove(timer *t) {
+  *t->pprev = t->next;
+  if (t->next) t->next->pprev = t->pprev;
+  t->next = NULL;
+  t->pprev = NULL;
+}
+
+//
+// place t in the slot of the wheel its expiry falls into.
+//
+static void wheel_insert(timer *t) {
+  uint64 expires = t->expires;
+  int64 delta = expires - g_wheel_time;
+
+  // an expired timer runs with the next slot.
+  if (delta < 0) {
+    expires = g_wheel_time;
+    delta = 0;
+  }
+  if (delta > TW_MAX_DELTA) {
+    expires = g_wheel_time + TW_MAX_DELTA;
+    delta = TW_MAX_DELTA;
+  }
+
+  int level = 0;
+  while (level < TW_LEVELS - 1 && delta >= (1L << (TW_BITS * (level + 1)))) level++;
+  slot_insert(&g_wheel[level][(expires >> (TW_BITS * level)) & TW_MASK], t);
+}
+
+//
+// take all timers out of the slot "slot". returns them as a list, whose head is kept
+// in *list (so that the timers can still be removed from it).
+//
+static void slot_take(timer **slot, timer **list) {
+  *list = *slot;
+  *slot = NULL;
+  if (*list) (*list)->pprev = list;
+}
+
+//
+// move the timers of slot "idx" of "level" down the wheel.
+//
+static void cascade(int level, int idx) {
+  timer *list, *t;
+  slot_take(&g_wheel[level][idx], &list);
+  while ((t = list) != NULL) {
+    slot_remove(t);
+    wheel_insert(t);
+  }
+}
+
+//
+// prepare t to call fn(t) on expiry. t must not be pending.
+//
+void timer_setup(timer *t, void (*fn)(timer *t), struct process_t *proc) {
+  t->next = NULL;
+  t->pprev = NULL;
+  t->fn = fn;
+  t->proc = proc;
+}
+
+//
+// start (or restart) timer t, to expire at "when" (mtime).
+//
+void add_timer(timer *t, uint64 when) {
+  if (timer_pending(t)) del_timer(t);
+  t->expires = (when + TIMER_WHEEL_RES - 1) / TIMER_WHEEL_RES;
+  wheel_insert(t);
+  g_nr_timers++;
+  timer_event_added(t->expires * TIMER_WHEEL_RES);
+}
+
+//
+// cancel timer t. returns non-zero if it was pending.
+//
+int del_timer(timer *t) {
+  if (!timer_pending(t)) return 0;
+  slot_remove(t);
+  g_nr_timers--;
+  return 1;
+}
+
+//
+// mtime units left until timer t expires, 0 if it is not pending.
+//
+uint64 timer_remaining(timer *t) {
+  uint64 now = read_csr(time);
+  if (!timer_pending(t) || t->expires * TIMER_WHEEL_RES <= now) return 0;
+  return t->expires * TIMER_WHEEL_RES - now;
+}
+
+int timer_nr_pending() { return g_nr_timers; }
+
+//
+// the time (mtime) the wheel has to advance by next, -1 if no timer is pending. this is
+// the expiry of the first timer in level 0, or the time a slot of an upper level is
+// cascaded, whichever comes first.
+//
+uint64 timer_next_expiry() {
+  uint64 next = -1UL;
+  if (g_nr_timers == 0) return next;
+
+  for (int level = 0; level < TW_LEVELS; level++) {
+    uint64 base = g_wheel_time >> (TW_BITS * level);
+    // the current slot of an upper level was cascaded already, and holds the timers of
+    // its next round.
+    for (int i = (level == 0 ? 0 : 1); i <= TW_SIZE; i++) {
+      if (g_wheel[level][(base + i) & TW_MASK] == NULL) continue;
+      uint64 when = ((base + i) << (TW_BITS * level)) * TIMER_WHEEL_RES;
+      if (when < next) next = when;
+      break;
+    }
+  }
+  return next;
+}
+
+//
+// advance the wheel to "now" (mtime), running the timers that expired on the way.
+//
+void timer_run(uint64 now) {
+  uint64 target = now / TIMER_WHEEL_RES;
+
+  while (g_wheel_time <= target) {
+    int idx = g_wheel_time & TW_MASK;
+    // a new round of level l - 1 starts: cascade the next slot of level l.
+    for (int level = 1; level < TW_LEVELS; level++) {
+      if ((g_wheel_time >> (TW_BITS * (level - 1))) & TW_MASK) break;
+      cascade(level, (g_wheel_time >> (TW_BITS * level)) & TW_MASK);
+    }
+
+    timer *list, *t;
+    slot_take(&g_wheel[0][idx], &list);
+    // timers added by the callbacks go to later slots.
+    g_wheel_time++;
+    while ((t = list) != NULL) {
+      slot_remove(t);
+      g_nr_timers--;
+      t->fn(t);
+    }
+  }
+}
+
+static void sleep_expired(timer *t) {
+  wake_up_all(&t->wq);
+}
+
+//
+// block the current process for "duration" mtime units. it is woken up by the first
+// timer tick after that.
+//
+void timer_sleep(uint64 duration) {
+  timer_setup(&current->sleep_timer, sleep_expired, current);
+  add_timer(&current->sleep_timer, read_csr(time) + duration);
+  sleep_on(&current->sleep_timer.wq);
+}
+
+//
+// the alarm of a process expired. as there are no signals, the process is terminated,
+// which is the default action of SIGALRM. a waiting process is woken up to exit.
+//
+static void alarm_expired(timer *t) {
+  process *p = t->proc;
+  sprint("alarm of process %d expired, terminating it.\n", p->pid);
+  kill_process(p);
+}
+
+uint64 timer_alarm(process *p, uint64 duration) {
+  uint64 left = timer_remaining(&p->alarm_timer);
+  del_timer(&p->alarm_timer);
+  if (duration) {
+    timer_setup(&p->alarm_timer, alarm_expired, p);
+    add_timer(&p->alarm_timer, read_csr(time) + duration);
+  }
+  return left;
+}
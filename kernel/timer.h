@@ -0,0 +1,39 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include "util/types.h"
+#include "wait.h"
+
+struct process_t;
+
+// a kernel timer. once added, it calls fn(t) when the time (mtime) reaches expires,
+// rounded up to TIMER_WHEEL_RES. timers live in the wheel of kernel/timer.c.
+typedef struct timer_t {
+  struct timer_t *next;
+  struct timer_t **pprev;  // the pointer to this timer in its slot, NULL if not pending
+  uint64 expires;          // in units of TIMER_WHEEL_RES
+  void (*fn)(struct timer_t *t);
+  struct process_t *proc;  // the process the timer belongs to
+  wait_queue wq;           // the processes waiting for it to expire
+} timer;
+
+void timer_setup(timer *t, void (*fn)(timer *t), struct process_t *proc);
+void add_timer(timer *t, uint64 when);
+int del_timer(timer *t);
+uint64 timer_remaining(timer *t);
+#define timer_pending(t) ((t)->pprev != NULL)
+
+// run the timers that expired by "now" (mtime). called on timer ticks.
+void timer_run(uint64 now);
+// number of timers waiting to expire
+int timer_nr_pending();
+// the time (mtime) the next timer is due, -1 if none
+uint64 timer_next_expiry();
+
+// block the current process for "duration" mtime units
+void timer_sleep(uint64 duration);
+// terminate process p "duration" mtime units from now, 0 to cancel. returns the time
+// that was left of the previous alarm.
+uint64 timer_alarm(struct process_t *p, uint64 duration);
+
+#endif
@@ -10,45 +10,81 @@
 #include "util/string.h"
 #include "spike_interface/spike_utils.h"
 #include "util/functions.h"
+#include "zram.h"
 
 /* --- utility functions for virtual address mapping --- */
+// paging mode in use: satp mode field, and the number of page table levels.
+uint64 g_satp_mode = SATP_SV39;
+int g_pt_levels = 3;
+
+// user address space layout of the paging mode in use.
+uint64 g_user_stack_top = USER_STACK_TOP_SV39;
+uint64 g_user_free_start = USER_FREE_ADDRESS_START_SV39;
+
+//
+// select the paging mode (SATP_SV39 or SATP_SV48), and the user layout that goes with
+// it. must be called before any page table is built.
+//
+void vm_set_mode(uint64 satp_mode)
+{
+  g_satp_mode = satp_mode;
+  if (satp_mode == SATP_SV48) {
+    g_pt_levels = 4;
+    g_user_stack_top = USER_STACK_TOP_SV48;
+    g_user_free_start = USER_FREE_ADDRESS_START_SV48;
+  } else {
+    g_pt_levels = 3;
+    g_user_stack_top = USER_STACK_TOP_SV39;
+    g_user_free_start = USER_FREE_ADDRESS_START_SV39;
+  }
+}
+
+static pte_t *walk(pagetable_t page_dir, uint64 va, int alloc, int *nr_alloc);
+
 //
 // establish mapping of virtual address [va, va+size] to phyiscal address [pa, pa+size]
 // with the permission of "perm".
+// returns the number of page-table pages allocated on the way, or -1 on failure.
 //
 int map_pages(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm)
 {
   uint64 first, last;
   pte_t *pte;
+  int nr_alloc = 0;
 
   for (first = ROUNDDOWN(va, PGSIZE), last = ROUNDDOWN(va + size - 1, PGSIZE);
        first <= last; first += PGSIZE, pa += PGSIZE)
   {
-    if ((pte = page_walk(page_dir, first, 1)) == 0)
+    if ((pte = walk(page_dir, first, 1, &nr_alloc)) == 0)
       return -1;
     if (*pte & PTE_V)
       panic("map_pages fails on mapping va (0x%lx) to pa (0x%lx)", first, pa);
     *pte = PA2PTE(pa) | perm | PTE_V;
   }
-  return 0;
+  return nr_alloc;
 }
 
 //
-// convert permission code to permission types of PTE
+// convert permission code to permission types of PTE.
+// kernel mappings get PTE_A/PTE_D preset, as an access/dirty fault taken in S-mode is
+// fatal. user mappings start with both bits clear, so that the first access (or write)
+// faults into user_vm_fixup_ad() and the working-set scanner sees real usage.
 //
 uint64 prot_to_type(int prot, int user)
 {
   uint64 perm = 0;
   if (prot & PROT_READ)
-    perm |= PTE_R | PTE_A;
+    perm |= PTE_R;
   if (prot & PROT_WRITE)
-    perm |= PTE_W | PTE_D;
+    perm |= PTE_W;
   if (prot & PROT_EXEC)
-    perm |= PTE_X | PTE_A;
+    perm |= PTE_X;
   if (perm == 0)
     perm = PTE_R;
   if (user)
     perm |= PTE_U;
+  else
+    perm |= PTE_A | ((perm & PTE_W) ? PTE_D : 0);
   return perm;
 }
 
@@ -57,6 +93,14 @@ uint64 prot_to_type(int prot, int user)
 // returns: PTE (page table entry) pointing to va.
 //
 pte_t *page_walk(pagetable_t page_dir, uint64 va, int alloc)
+{
+  return walk(page_dir, va, alloc, NULL);
+}
+
+//
+// page_walk() that also counts the page-table pages it allocates in *nr_alloc.
+//
+static pte_t *walk(pagetable_t page_dir, uint64 va, int alloc, int *nr_alloc)
 {
   if (va >= MAXVA)
     panic("page_walk");
@@ -65,9 +109,9 @@ pte_t *page_walk(pagetable_t page_dir, uint64 va, int alloc)
   pagetable_t pt = page_dir;
 
   // traverse from page directory to page table.
-  // as we use risc-v sv39 paging scheme, there will be 3 layers: page dir,
-  // page medium dir, and page table.
-  for (int level = 2; level > 0; level--)
+  // in risc-v sv39 paging scheme, there are 3 layers: page dir, page medium dir, and
+  // page table. sv48 adds one more layer on top.
+  for (int level = g_pt_levels - 1; level > 0; level--)
   {
     // macro "PX" gets the PTE index in page table of current level
     // "pte" points to the entry of current level
@@ -83,12 +127,12 @@ pte_t *page_walk(pagetable_t page_dir, uint64 va, int alloc)
     else
     { // PTE invalid (not exist).
       // allocate a page (to be the new pagetable), if alloc == 1
-      if (alloc && ((pt = (pte_t *)alloc_page(1)) != 0))
+      if (alloc && ((pt = (pte_t *)alloc_zeroed_page()) != 0))
       {
-        memset(pt, 0, PGSIZE);
         // writes the physical address of newly allocated page to pte, to establish the
         // page table tree.
         *pte = PA2PTE(pt) | PTE_V;
+        if (nr_alloc) (*nr_alloc)++;
       }
       else // returns NULL, if alloc == 0, or no more physical page remains
         return 0;
@@ -110,6 +154,10 @@ uint64 lookup_pa(pagetable_t pagetable, uint64 va)
   if (va >= MAXVA)
     return 0;
 
+  // a page in the compressed store is brought back first.
+  if (zram_swapin(pagetable, va) < 0)
+    return 0;
+
   pte = page_walk(pagetable, va, 0);
   if (pte == 0 || (*pte & PTE_V) == 0 || ((*pte & PTE_R) == 0 && (*pte & PTE_W) == 0))
     return 0;
@@ -131,7 +179,7 @@ pagetable_t g_kernel_pagetable;
 void kern_vm_map(pagetable_t page_dir, uint64 va, uint64 pa, uint64 sz, int perm)
 {
   // map_pages is defined in kernel/vmm.c
-  if (map_pages(page_dir, va, sz, pa, perm) != 0)
+  if (map_pages(page_dir, va, sz, pa, perm) < 0)
     panic("kern_vm_map");
 }
 
@@ -183,29 +231,64 @@ void *user_va_to_pa(pagetable_t page_dir, void *va)
   // Also, it is possible that "va" is not mapped at all. in such case, we can find
   // invalid PTE, and should return NULL.
   // panic( "You have to implement user_va_to_pa (convert user va to pa) to print messages in lab2_1.\n" );
+  if ((uint64)va >= MAXVA)
+    return NULL;
+  // a page in the compressed store is brought back first.
+  if (zram_swapin(page_dir, (uint64)va) < 0)
+    return NULL;
+
   pte_t *pte = page_walk(page_dir, (uint64)(va), 0);
+  if (pte == 0 || (*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U))
+    return NULL;
   uint64 pa = 0;
   pa += PTE2PA((*pte));
   pa += ((uint64)(va) & ((1<<PGSHIFT)-1));
   return (void *)pa;
 }
 
+//
+// copy len bytes from src in the kernel to the user address dst of page_dir (that of
+// current), page by page, as consecutive user pages need not be consecutive in physical
+// memory. copy-on-write pages get broken. returns -1 if a page of dst is not mapped
+// writable for the user, or out of memory.
+//
+int user_vm_copyout(pagetable_t page_dir, uint64 dst, const void *src, uint64 len)
+{
+  while (len > 0) {
+    uint64 n = PGSIZE - (dst & (PGSIZE - 1));
+    if (n > len) n = len;
+    if (user_vm_break_cow(page_dir, dst) < 0) return -1;
+    void *pa = user_va_to_pa(page_dir, (void *)dst);
+    if (pa == NULL || !(*page_walk(page_dir, dst, 0) & PTE_W)) return -1;
+
+    memcpy(pa, src, n);
+    dst += n;
+    src = (const char *)src + n;
+    len -= n;
+  }
+  return 0;
+}
+
 //
 // maps virtual address [va, va+sz] to [pa, pa+sz] (for user application).
+// returns the number of page-table pages allocated for the mapping.
 //
-void user_vm_map(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm)
+int user_vm_map(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  if (map_pages(page_dir, va, size, pa, perm) != 0)
+  int nr_alloc = map_pages(page_dir, va, size, pa, perm);
+  if (nr_alloc < 0)
   {
     panic("fail to user_vm_map .\n");
   }
+  return nr_alloc;
 }
 
 //
 // unmap virtual address [va, va+size] from the user app.
 // reclaim the physical pages if free!=0
+// returns the number of resident pages that were unmapped.
 //
-void user_vm_unmap(pagetable_t page_dir, uint64 va, uint64 size, int free) {
+int user_vm_unmap(pagetable_t page_dir, uint64 va, uint64 size, int free) {
   // TODO (lab2_2): implement user_vm_unmap to disable the mapping of the virtual pages
   // in [va, va+size], and free the corresponding physical pages used by the virtual
   // addresses when if 'free' (the last parameter) is not zero.
@@ -214,9 +297,182 @@ void user_vm_unmap(pagetable_t page_dir, uint64 va, uint64 size, int free) {
   // as naive_free reclaims only one page at a time, you only need to consider one page
   // to make user/app_naive_malloc to behave correctly.
   // panic( "You have to implement user_vm_unmap to free pages using naive_free in lab2_2.\n" );
-  uint64 pa = lookup_pa(page_dir, va);
-  if(free)
-    free_page((void *)pa);
+  int nr_unmapped = 0;
+  for (uint64 a = ROUNDDOWN(va, PGSIZE); a < va + size; a += PGSIZE) {
+    pte_t *pte = page_walk(page_dir, a, 0);
+    if (pte == 0) continue;
+    if ((*pte & PTE_V) == 0) {
+      if (*pte & PTE_ZRAM) zram_free(*pte);
+      *pte = 0;
+      continue;
+    }
+
+    // the page may be shared (cf. kernel/ksm.c), so only drop our reference to it.
+    if (free) put_page((void *)PTE2PA(*pte));
+    *pte = 0;
+    nr_unmapped++;
+  }
+  return nr_unmapped;
+}
+
+//
+// resolve a write to a copy-on-write page at "va": the page becomes writable again if
+// this mapping holds its only reference, otherwise the mapping gets a private copy.
+// page_dir is that of current. returns 1 if va was a copy-on-write page, 0 if it was
+// not, -1 if out of memory.
+//
+int user_vm_break_cow(pagetable_t page_dir, uint64 va)
+{
+  if (va >= MAXVA) return 0;
+
+  pte_t *pte = page_walk(page_dir, va, 0);
+  if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_COW) == 0) return 0;
+
+  void *pa = (void *)PTE2PA(*pte);
+  uint64 flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W | PTE_A | PTE_D;
+  if (page_ref(pa) > 1) {
+    void *copy = alloc_page();
+    if (copy == 0) return -1;
+    memcpy(copy, pa, PGSIZE);
+    *pte = PA2PTE(copy) | flags;
+    // the other threads of current still read the shared frame through their TLB.
+    tlb_shootdown(current);
+    put_page(pa);
+    return 1;
+  }
+
+  *pte = PA2PTE(pa) | flags;
+  return 1;
+}
+
+//
+// software management of the accessed/dirty bits of a user page. called on a page fault
+// at "va": if the page is mapped with sufficient permission and only lacks PTE_A (or
+// PTE_D for a write), set the bit(s) and return 1, so the faulting instruction can simply
+// be restarted. returns 0 if the fault is a genuine one.
+//
+int user_vm_fixup_ad(pagetable_t page_dir, uint64 va, int write)
+{
+  if (va >= MAXVA) return 0;
+
+  pte_t *pte = page_walk(page_dir, va, 0);
+  if (pte == 0 || (*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U)) return 0;
+  if (write && !(*pte & PTE_W)) return 0;
+
+  uint64 bits = PTE_A | (write ? PTE_D : 0);
+  if ((*pte & bits) == bits) return 0;
+
+  *pte |= bits;
+  return 1;
+}
+
+//
+// recursively visit the user (PTE_U) leaf entries of a page table page at "level".
+//
+static void walk_user_level(pagetable_t pt, int level, uint64 va_base,
+                            void (*fn)(pte_t *pte, uint64 va, void *arg), void *arg)
+{
+  for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+    pte_t *pte = pt + i;
+    if (!(*pte & PTE_V)) continue;
+
+    uint64 va = va_base | ((uint64)i << PXSHIFT(level));
+    if (level > 0 && !(*pte & (PTE_R | PTE_W | PTE_X)))
+      walk_user_level((pagetable_t)PTE2PA(*pte), level - 1, va, fn, arg);
+    else if (*pte & PTE_U)
+      fn(pte, va, arg);
+  }
+}
+
+//
+// call fn(pte, va, arg) for every valid user leaf mapping in page_dir.
+//
+void user_vm_walk(pagetable_t page_dir, void (*fn)(pte_t *pte, uint64 va, void *arg),
+                  void *arg)
+{
+  walk_user_level(page_dir, g_pt_levels - 1, 0, fn, arg);
+}
+
+static void free_pt_level(pagetable_t pt, int level)
+{
+  for (int i = 0; i < PGSIZE / sizeof(pte_t); i++)
+    if (level > 0 && (pt[i] & PTE_V) && !(pt[i] & (PTE_R | PTE_W | PTE_X)))
+      free_pt_level((pagetable_t)PTE2PA(pt[i]), level - 1);
+  free_page(pt);
+}
+
+//
+// free the page-table pages of page_dir. the pages it maps are left alone.
+//
+void free_pagetable(pagetable_t page_dir)
+{
+  free_pt_level(page_dir, g_pt_levels - 1);
+}
+
+static void free_user_level(pagetable_t pt, int level)
+{
+  for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+    pte_t pte = pt[i];
+    if (!(pte & PTE_V)) {
+      if (pte & PTE_ZRAM) zram_free(pte);
+    } else if (level > 0 && !(pte & (PTE_R | PTE_W | PTE_X))) {
+      free_user_level((pagetable_t)PTE2PA(pte), level - 1);
+    } else if (pte & PTE_U) {
+      put_page((void *)PTE2PA(pte));
+    }
+  }
+  free_page(pt);
+}
+
+//
+// drop the user pages of the page-table page pt at "level", and free the page-table pages
+// below it that are left empty. returns the number of page-table pages left, pt
+// included, or 0 if pt maps nothing anymore.
+//
+static int clear_user_level(pagetable_t pt, int level)
+{
+  int nr_left = 0, kernel_leaf = 0;
+  for (int i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+    pte_t pte = pt[i];
+    if (!(pte & PTE_V)) {
+      if (pte & PTE_ZRAM) zram_free(pte);
+      pt[i] = 0;
+    } else if (level > 0 && !(pte & (PTE_R | PTE_W | PTE_X))) {
+      int n = clear_user_level((pagetable_t)PTE2PA(pte), level - 1);
+      if (n == 0) {
+        free_page((void *)PTE2PA(pte));
+        pt[i] = 0;
+      }
+      nr_left += n;
+    } else if (pte & PTE_U) {
+      put_page((void *)PTE2PA(pte));
+      pt[i] = 0;
+    } else {
+      kernel_leaf = 1;
+    }
+  }
+  return (nr_left || kernel_leaf) ? nr_left + 1 : 0;
+}
+
+//
+// empty a user address space for reuse: drop the user pages and compressed pages mapped
+// by page_dir, as user_vm_free() does, but keep page_dir with its kernel mappings (the
+// trapframe, the trap vector). returns the number of page-table pages left.
+//
+int user_vm_clear(pagetable_t page_dir)
+{
+  int n = clear_user_level(page_dir, g_pt_levels - 1);
+  return n ? n : 1;
+}
+
+//
+// tear down a user address space: drop the user pages and compressed (zram) pages mapped
+// by page_dir, then free its page-table pages. kernel pages mapped without PTE_U (the
+// trapframe, the trap vector) are left alone.
+//
+void user_vm_free(pagetable_t page_dir)
+{
+  free_user_level(page_dir, g_pt_levels - 1);
 }
 
 //
@@ -14,6 +14,7 @@ enum VMPermision {
   PROT_EXEC = 4,
 };
 
+void vm_set_mode(uint64 satp_mode);
 uint64 prot_to_type(int prot, int user);
 pte_t *page_walk(pagetable_t pagetable, uint64 va, int alloc);
 uint64 lookup_pa(pagetable_t pagetable, uint64 va);
@@ -29,8 +30,16 @@ void kern_vm_init(void);
 
 /* --- user page table --- */
 void *user_va_to_pa(pagetable_t page_dir, void *va);
-void user_vm_map(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm);
-void user_vm_unmap(pagetable_t page_dir, uint64 va, uint64 size, int free);
+int user_vm_map(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm);
+int user_vm_unmap(pagetable_t page_dir, uint64 va, uint64 size, int free);
+int user_vm_break_cow(pagetable_t page_dir, uint64 va);
+int user_vm_copyout(pagetable_t page_dir, uint64 dst, const void *src, uint64 len);
+int user_vm_fixup_ad(pagetable_t page_dir, uint64 va, int write);
+void user_vm_walk(pagetable_t page_dir, void (*fn)(pte_t *pte, uint64 va, void *arg),
+                  void *arg);
+void free_pagetable(pagetable_t page_dir);
+void user_vm_free(pagetable_t page_dir);
+int user_vm_clear(pagetable_t page_dir);
 void print_proc_vmspace(process* proc);
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef _WAIT_H_
+#define _WAIT_H_
+
+#include "util/types.h"
+
+struct process_t;
+
+// a FIFO queue of processes, linked through their queue_next/queue_prev fields. a
+// process is in at most one queue at a time, recorded in its on_queue field, so that
+// enqueue, dequeue and removal are all O(1).
+typedef struct proc_queue_t {
+  struct process_t *head;
+  struct process_t *tail;
+  int nr;
+} proc_queue;
+
+void proc_queue_push(proc_queue *q, struct process_t *proc);
+struct process_t *proc_queue_pop(proc_queue *q);
+void proc_queue_remove(proc_queue *q, struct process_t *proc);
+
+// the processes waiting for an event, kept in the object the event concerns (e.g., the
+// children of a process exiting, a timer expiring). waking up costs only the processes
+// woken. implemented in kernel/sched.c.
+typedef proc_queue wait_queue;
+
+// block the current process on wq, until it is woken up.
+void sleep_on(wait_queue *wq);
+void wake_up_one(wait_queue *wq);
+void wake_up_all(wait_queue *wq);
+
+// block the current process on wq until "cond" holds. cond is evaluated again on every
+// wakeup.
+#define wait_event(wq, cond) \
+  do {                       \
+    while (!(cond))          \
+      sleep_on(wq);          \
+  } while (0)
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Working-set estimation by accessed-bit scanning.
+ *
+ * Every WSS_SCAN_INTERVAL timer ticks, wss_scan() walks the user page table of each
+ * live process. A leaf PTE with PTE_A set was referenced since the previous scan, one
+ * with PTE_D set was written. Both bits are then cleared, so that the next access (or
+ * write) faults into user_vm_fixup_ad() (kernel/vmm.c) and sets them again. pages
+ * that stay unreferenced are handed to the compressed store (kernel/zram.c).
+ */
+
+#include "wss.h"
+#include "vmm.h"
+#include "zram.h"
+#include "riscv.h"
+
+typedef struct wss_sample_t {
+  process *p;
+  uint64 rss;
+  uint64 accessed;
+  uint64 dirty;
+} wss_sample;
+
+//
+// sample and clear the accessed/dirty bits of one user leaf PTE.
+//
+static void wss_scan_pte(pte_t *pte, uint64 va, void *arg) {
+  wss_sample *s = (wss_sample *)arg;
+
+  int accessed = (*pte & PTE_A) != 0;
+  if (accessed) s->accessed++;
+  if (*pte & PTE_D) s->dirty++;
+  *pte &= ~(PTE_A | PTE_D);
+
+  // cold pages may move to the compressed store, and are then no longer resident.
+  zram_age_page(s->p, pte, accessed);
+  if (*pte & PTE_V) s->rss++;
+}
+
+//
+// scan the page tables of all live processes, and record their resident set, working
+// set and dirty pages of the last interval.
+//
+void wss_scan() {
+  process *p;
+  for_each_process(p) {
+    // threads are sampled with their leader, whose address space they share.
+    if (p->status == ZOMBIE || p->pagetable == NULL || p->leader != p) continue;
+    // the TLB of another hart running p would not see its bits cleared.
+    if (proc_running_elsewhere(p)) continue;
+
+    wss_sample s = {p, 0, 0, 0};
+    user_vm_walk(p->pagetable, wss_scan_pte, &s);
+
+    p->wss_rss = s.rss;
+    p->wss_pages = s.accessed;
+    p->wss_dirty = s.dirty;
+    if (s.accessed > p->wss_peak) p->wss_peak = s.accessed;
+    p->wss_scans++;
+  }
+
+  // cleared PTE_A/PTE_D bits must not survive in the TLB.
+  flush_tlb();
+}
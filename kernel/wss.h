@@ -0,0 +1,9 @@
+#ifndef _WSS_H_
+#define _WSS_H_
+
+#include "process.h"
+
+// sample and clear the accessed/dirty bits of all live processes
+void wss_scan();
+
+#endif
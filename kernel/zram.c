@@ -0,0 +1,371 @@
+/*
+ * Compressed in-memory page store (zram-style).
+ *
+ * Cold anonymous pages found by the working-set scanner (kernel/wss.c) are compressed
+ * with a small LZ77-family codec into a pool of physical pages taken from pmm.c. The
+ * PTE of such a page is left invalid, marked PTE_ZRAM, with the store slot in its PPN
+ * field. touching the page faults, and zram_swapin() decompresses it into a new frame.
+ *
+ * the pool pages are divided into ZRAM_CHUNK-byte chunks, and a compressed page takes a
+ * contiguous run of chunks within one pool page.
+ */
+
+#include "zram.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "config.h"
+#include "memlayout.h"
+#include "util/string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+#define ZRAM_CHUNK 256
+#define ZRAM_CHUNKS_PER_PAGE (PGSIZE / ZRAM_CHUNK)
+// pages compressing worse than this are not worth storing
+#define ZRAM_MAX_COMP (PGSIZE * 3 / 4)
+#define ZRAM_MAX_SLOTS 8192
+
+// policy decisions for a cold page.
+enum zram_decision {
+  ZRAM_KEEP,      // leave the page resident
+  ZRAM_COMPRESS,  // move the page to the compressed store
+  ZRAM_SWAP,      // move the page to host swap (no backing store in PKE yet)
+};
+
+typedef struct zram_pool_page_t {
+  uint8 *page;
+  uint16 used;    // bitmap of the chunks in use
+} zram_pool_page;
+
+typedef struct zram_slot_t {
+  process *owner; // process the page is charged to
+  uint16 pool;    // index in g_pool
+  uint8 chunk;    // first chunk
+  uint8 nchunks;
+  uint16 len;     // compressed length, 0 if the slot is free
+  int next_free;
+} zram_slot;
+
+static zram_pool_page g_pool[ZRAM_POOL_PAGES];
+static zram_slot g_slots[ZRAM_MAX_SLOTS];
+static int g_free_slot = -1;
+static int g_zram_ready = 0;
+
+// number of working-set scans since each physical page was last accessed
+static uint8 g_page_age[PKE_MAX_ALLOWABLE_RAM / PGSIZE];
+#define PAGE_AGE(pa) (g_page_age[((uint64)(pa) - DRAM_BASE) >> PGSHIFT])
+
+zram_stat g_zram_stat;
+
+/* --- LZ codec --- */
+//
+// a compressed block is a list of sequences: a token byte (high nibble: literal count,
+// low nibble: match length - LZ_MINMATCH; 15 means more length bytes follow, each 255
+// adding up until a smaller one), the literals, then a 16-bit match offset. the last
+// sequence carries only literals.
+//
+#define LZ_MINMATCH 4
+#define LZ_HASH_BITS 12
+
+static uint16 g_lz_table[1 << LZ_HASH_BITS];
+
+static inline uint32 lz_read32(const uint8 *p) {
+  // bytewise, misaligned loads trap on our machine.
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static inline uint32 lz_hash(uint32 v) { return (v * 2654435761U) >> (32 - LZ_HASH_BITS); }
+
+static uint8 *lz_put_len(uint8 *op, int len) {
+  for (; len >= 255; len -= 255) *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+//
+// emit one sequence. returns the new output position, or NULL if it does not fit.
+//
+static uint8 *lz_emit(uint8 *op, uint8 *oend, const uint8 *lit, int nlit, int offset,
+                      int mlen) {
+  int ml = mlen ? mlen - LZ_MINMATCH : 0;
+  if (op + 1 + nlit / 255 + 1 + nlit + 2 + ml / 255 + 1 > oend) return NULL;
+
+  *op++ = (MIN(nlit, 15) << 4) | MIN(ml, 15);
+  if (nlit >= 15) op = lz_put_len(op, nlit - 15);
+  memcpy(op, lit, nlit);
+  op += nlit;
+
+  if (mlen) {
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    if (ml >= 15) op = lz_put_len(op, ml - 15);
+  }
+  return op;
+}
+
+//
+// compress n bytes at src into at most cap bytes at dst. returns the compressed length,
+// or 0 if it does not fit.
+//
+static int lz_compress(const uint8 *src, int n, uint8 *dst, int cap) {
+  uint8 *op = dst, *oend = dst + cap;
+  int ip = 0, anchor = 0;
+
+  memset(g_lz_table, 0, sizeof(g_lz_table));
+  while (ip + LZ_MINMATCH <= n) {
+    uint32 seq = lz_read32(src + ip);
+    uint32 h = lz_hash(seq);
+    int cand = g_lz_table[h];
+    g_lz_table[h] = ip;
+
+    if (cand >= ip || lz_read32(src + cand) != seq) {
+      ip++;
+      continue;
+    }
+
+    int len = LZ_MINMATCH;
+    while (ip + len < n && src[cand + len] == src[ip + len]) len++;
+
+    if ((op = lz_emit(op, oend, src + anchor, ip - anchor, ip - cand, len)) == NULL) return 0;
+    ip += len;
+    anchor = ip;
+  }
+
+  if ((op = lz_emit(op, oend, src + anchor, n - anchor, 0, 0)) == NULL) return 0;
+  return op - dst;
+}
+
+static const uint8 *lz_get_len(const uint8 *ip, const uint8 *iend, int *len) {
+  uint8 b;
+  do {
+    if (ip >= iend) return NULL;
+    b = *ip++;
+    *len += b;
+  } while (b == 255);
+  return ip;
+}
+
+//
+// decompress n bytes at src into cap bytes at dst. returns the decompressed length, or
+// -1 if the block is corrupted.
+//
+static int lz_decompress(const uint8 *src, int n, uint8 *dst, int cap) {
+  const uint8 *ip = src, *iend = src + n;
+  uint8 *op = dst, *oend = dst + cap;
+
+  while (ip < iend) {
+    uint8 token = *ip++;
+
+    int nlit = token >> 4;
+    if (nlit == 15 && (ip = lz_get_len(ip, iend, &nlit)) == NULL) return -1;
+    if (ip + nlit > iend || op + nlit > oend) return -1;
+    memcpy(op, ip, nlit);
+    ip += nlit;
+    op += nlit;
+    if (ip >= iend) break;
+
+    if (ip + 2 > iend) return -1;
+    int offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    int mlen = token & 15;
+    if (mlen == 15 && (ip = lz_get_len(ip, iend, &mlen)) == NULL) return -1;
+    mlen += LZ_MINMATCH;
+
+    if (offset == 0 || offset > op - dst || op + mlen > oend) return -1;
+    // byte by byte, the match may overlap the output.
+    for (const uint8 *m = op - offset; mlen > 0; mlen--) *op++ = *m++;
+  }
+  return op - dst;
+}
+
+/* --- pool management --- */
+static void zram_init() {
+  for (int i = 0; i < ZRAM_MAX_SLOTS; i++) g_slots[i].next_free = i + 1;
+  g_slots[ZRAM_MAX_SLOTS - 1].next_free = -1;
+  g_free_slot = 0;
+  g_zram_ready = 1;
+}
+
+//
+// find a run of n free chunks in a pool page, adding a pool page if needed.
+// returns the slot index, or -1 if the store is full.
+//
+static int zram_alloc(int len) {
+  int n = ROUNDUP(len, ZRAM_CHUNK) / ZRAM_CHUNK;
+  uint16 mask = (1 << n) - 1;
+  if (g_free_slot < 0) return -1;
+
+  for (int i = 0; i < ZRAM_POOL_PAGES; i++) {
+    if (g_pool[i].page == NULL) {
+      if ((g_pool[i].page = (uint8 *)alloc_page()) == NULL) return -1;
+      g_pool[i].used = 0;
+      g_zram_stat.pool_pages++;
+    }
+
+    for (int c = 0; c + n <= ZRAM_CHUNKS_PER_PAGE; c++) {
+      if (g_pool[i].used & (mask << c)) continue;
+
+      g_pool[i].used |= mask << c;
+      int s = g_free_slot;
+      g_free_slot = g_slots[s].next_free;
+      g_slots[s].pool = i;
+      g_slots[s].chunk = c;
+      g_slots[s].nchunks = n;
+      g_slots[s].len = len;
+      return s;
+    }
+  }
+  return -1;
+}
+
+static void zram_release(int s) {
+  zram_slot *slot = &g_slots[s];
+  zram_pool_page *pp = &g_pool[slot->pool];
+
+  pp->used &= ~(((1 << slot->nchunks) - 1) << slot->chunk);
+  if (pp->used == 0) {
+    free_page(pp->page);
+    pp->page = NULL;
+    g_zram_stat.pool_pages--;
+  }
+
+  g_zram_stat.stored--;
+  g_zram_stat.orig_bytes -= PGSIZE;
+  g_zram_stat.comp_bytes -= slot->len;
+  slot->len = 0;
+  slot->next_free = g_free_slot;
+  g_free_slot = s;
+}
+
+/* --- policy --- */
+//
+// decide what to do with a cold page that compresses to "clen" bytes (0 if it does not
+// compress below ZRAM_MAX_COMP).
+//
+static int zram_policy(int clen) {
+  if (clen > 0) return ZRAM_COMPRESS;
+  // incompressible pages would go to host swap, which PKE does not implement; they stay
+  // resident.
+  return ZRAM_KEEP;
+}
+
+//
+// try to move the cold user page of p mapped by *pte into the compressed store.
+// returns 1 if the page was stored, 0 if it stays resident.
+//
+static int zram_store(process *p, pte_t *pte) {
+  // static, as the kernel stack is a single page.
+  static uint8 buf[ZRAM_MAX_COMP];
+  void *pa = (void *)PTE2PA(*pte);
+  if (!g_zram_ready) zram_init();
+
+  uint64 start = read_csr(cycle);
+  int clen = lz_compress((uint8 *)pa, PGSIZE, buf, ZRAM_MAX_COMP);
+  g_zram_stat.store_cycles += read_csr(cycle) - start;
+
+  int s;
+  if (zram_policy(clen) != ZRAM_COMPRESS || (s = zram_alloc(clen)) < 0) {
+    g_zram_stat.nr_rejects++;
+    return 0;
+  }
+
+  memcpy(g_pool[g_slots[s].pool].page + g_slots[s].chunk * ZRAM_CHUNK, buf, clen);
+  g_slots[s].owner = p;
+  g_zram_stat.stored++;
+  g_zram_stat.nr_stores++;
+  g_zram_stat.orig_bytes += PGSIZE;
+  g_zram_stat.comp_bytes += clen;
+
+  // keep the permission bits, so that the page comes back with the same mapping.
+  *pte = ((uint64)s << 10) | (PTE_FLAGS(*pte) & ~(PTE_V | PTE_A | PTE_D)) | PTE_ZRAM;
+  put_page(pa);
+  mm_uncharge(p, MM_RSS, 1);
+  return 1;
+}
+
+//
+// whether the user page at *pte may go to the compressed store: only private anonymous
+// pages do, code and shared pages do not.
+//
+static int zram_eligible(pte_t *pte) {
+  return !(*pte & (PTE_X | PTE_COW)) && page_ref((void *)PTE2PA(*pte)) == 1;
+}
+
+//
+// age the user page at *pte of process p by one working-set scan, and move it to the
+// compressed store if it has gone cold while memory is short.
+//
+void zram_age_page(process *p, pte_t *pte, int accessed) {
+  void *pa = (void *)PTE2PA(*pte);
+  if (accessed) {
+    PAGE_AGE(pa) = 0;
+    return;
+  }
+  if (PAGE_AGE(pa) < 255) PAGE_AGE(pa)++;
+
+  if (PAGE_AGE(pa) < ZRAM_COLD_SCANS || !zram_eligible(pte)) return;
+  if (nr_free_pages() >= ZRAM_FREE_WATERMARK) return;
+
+  zram_store(p, pte);
+}
+
+typedef struct zram_reclaim_t {
+  process *p;
+  uint64 nr;
+} zram_reclaim_ctl;
+
+static void zram_reclaim_pte(pte_t *pte, uint64 va, void *arg) {
+  zram_reclaim_ctl *ctl = (zram_reclaim_ctl *)arg;
+  if (ctl->nr == 0 || (*pte & PTE_A) || !zram_eligible(pte)) return;
+  if (zram_store(ctl->p, pte)) ctl->nr--;
+}
+
+//
+// compress up to nr pages of p that were not accessed since the last working-set scan,
+// regardless of the free memory. used to push a process back under its soft limit.
+// returns the number of pages reclaimed.
+//
+int zram_reclaim(process *p, uint64 nr) {
+  zram_reclaim_ctl ctl = {p, nr};
+  if (!g_zram_ready) zram_init();
+
+  user_vm_walk(p->pagetable, zram_reclaim_pte, &ctl);
+  flush_tlb();
+  return nr - ctl.nr;
+}
+
+//
+// bring a compressed page at va back. returns 1 if it was compressed, 0 if it was not,
+// -1 if out of memory.
+//
+int zram_swapin(pagetable_t page_dir, uint64 va) {
+  if (va >= MAXVA) return 0;
+
+  pte_t *pte = page_walk(page_dir, va, 0);
+  if (pte == 0 || (*pte & PTE_V) || !(*pte & PTE_ZRAM)) return 0;
+
+  void *pa = alloc_page();
+  if (pa == NULL) return -1;
+
+  int s = *pte >> 10;
+  zram_slot *slot = &g_slots[s];
+  uint64 start = read_csr(cycle);
+  int len = lz_decompress(g_pool[slot->pool].page + slot->chunk * ZRAM_CHUNK, slot->len,
+                          (uint8 *)pa, PGSIZE);
+  g_zram_stat.load_cycles += read_csr(cycle) - start;
+  if (len != PGSIZE) panic("zram: corrupted compressed page at %lx.\n", va);
+
+  g_zram_stat.nr_loads++;
+  *pte = PA2PTE(pa) | (PTE_FLAGS(*pte) & ~PTE_ZRAM) | PTE_V;
+  PAGE_AGE(pa) = 0;
+  mm_charge(slot->owner, MM_RSS, 1);
+  zram_release(s);
+  return 1;
+}
+
+//
+// release the compressed copy referenced by a (non-valid) PTE_ZRAM entry.
+//
+void zram_free(pte_t pte) {
+  zram_release(pte >> 10);
+}
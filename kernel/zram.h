@@ -0,0 +1,22 @@
+#ifndef _ZRAM_H_
+#define _ZRAM_H_
+
+#include "riscv.h"
+#include "process.h"
+#include "syscall.h"
+
+// age the user page at *pte of process p by one working-set scan, and move it to the
+// compressed store if it has gone cold.
+void zram_age_page(process *p, pte_t *pte, int accessed);
+// bring a compressed page at va back. returns 1 if it was compressed, 0 if it was not,
+// -1 if out of memory.
+int zram_swapin(pagetable_t page_dir, uint64 va);
+// release the compressed copy referenced by a (non-valid) PTE_ZRAM entry
+void zram_free(pte_t pte);
+// compress up to nr pages of p that were not accessed recently
+int zram_reclaim(process *p, uint64 nr);
+
+
+extern zram_stat g_zram_stat;
+
+#endif
@@ -24,6 +24,13 @@ typedef struct {
 #define atomic_set(ptr, val) (*(volatile typeof(*(ptr))*)(ptr) = val)
 #define atomic_read(ptr) (*(volatile typeof(*(ptr))*)(ptr))
 
+#ifdef __riscv_atomic
+// harts may race on these (cf. NCPU in kernel/config.h), use the A extension.
+#define atomic_add(ptr, inc) __sync_fetch_and_add(ptr, inc)
+#define atomic_or(ptr, inc) __sync_fetch_and_or(ptr, inc)
+#define atomic_swap(ptr, swp) __sync_lock_test_and_set(ptr, swp)
+#define atomic_cas(ptr, cmp, swp) __sync_val_compare_and_swap(ptr, cmp, swp)
+#else
 #define atomic_binop(ptr, inc, op)         \
   ({                                       \
     long flags = disable_irqsave();        \
@@ -43,6 +50,7 @@ typedef struct {
     enable_irqrestore(flags);                               \
     res;                                                    \
   })
+#endif
 
 static inline int spinlock_trylock(spinlock_t* lock) {
   int res = atomic_swap(&lock->lock, -1);
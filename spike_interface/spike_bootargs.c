@@ -0,0 +1,50 @@
+/*
+ * scanning the kernel command line from the DTS (Device Tree String).
+ * output: the "bootargs" property of the "chosen" node, stored in g_bootargs.
+ */
+#include "dts_parse.h"
+#include "spike_interface/spike_bootargs.h"
+#include "spike_interface/spike_utils.h"
+#include "util/string.h"
+
+char g_bootargs[BOOTARGS_MAX];
+
+static void bootargs_prop(const struct fdt_scan_prop *prop, void *extra) {
+  if (strcmp(prop->node->name, "chosen") || strcmp(prop->name, "bootargs")) return;
+  safestrcpy(g_bootargs, (const char *)prop->value, BOOTARGS_MAX);
+}
+
+// scanning the kernel command line
+void query_bootargs(uint64 fdt) {
+  struct fdt_cb cb;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.prop = bootargs_prop;
+
+  g_bootargs[0] = 0;
+  fdt_scan(fdt, &cb);
+}
+
+//
+// look up "key=value" in the kernel command line, whose arguments are separated by
+// spaces. copies the value (at most n-1 characters) into value. returns 0 if the key
+// is found, -1 otherwise.
+//
+int bootarg_get(const char *key, char *value, int n) {
+  int klen = strlen(key);
+  const char *s = g_bootargs;
+
+  while (*s) {
+    while (*s == ' ') s++;
+    const char *arg = s;
+    while (*s && *s != ' ') s++;
+    if (s - arg > klen && arg[klen] == '=' && memcmp(arg, key, klen) == 0) {
+      int len = s - arg - klen - 1;
+      if (len > n - 1) len = n - 1;
+      memcpy(value, arg + klen + 1, len);
+      value[len] = 0;
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,14 @@
+#ifndef _SPIKE_BOOTARGS_H_
+#define _SPIKE_BOOTARGS_H_
+
+#include "util/types.h"
+
+// the kernel command line, taken from "bootargs" of the "chosen" node of the DTS
+// (spike --bootargs=...). empty if there is none.
+#define BOOTARGS_MAX 256
+extern char g_bootargs[BOOTARGS_MAX];
+
+void query_bootargs(uint64 fdt);
+int bootarg_get(const char *key, char *value, int n);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * scanning the ISA string of the harts from the DTS (Device Tree String).
+ * output: the "riscv,isa" property of the first "cpu" node, stored in g_isa_string.
+ */
+#include "dts_parse.h"
+#include "spike_interface/spike_isa.h"
+#include "util/string.h"
+
+char g_isa_string[ISA_STRING_MAX];
+
+static void isa_prop(const struct fdt_scan_prop *prop, void *extra) {
+  if (g_isa_string[0] || strcmp(prop->name, "riscv,isa")) return;
+  safestrcpy(g_isa_string, (const char *)prop->value, ISA_STRING_MAX);
+}
+
+// scanning the ISA string
+void query_isa(uint64 fdt) {
+  struct fdt_cb cb;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.prop = isa_prop;
+
+  g_isa_string[0] = 0;
+  fdt_scan(fdt, &cb);
+}
+
+//
+// check for a multi-letter extension (e.g., "sstc") in the ISA string, where such
+// extensions follow the base ISA, each preceded by '_'. returns non-zero if it is there.
+//
+int isa_has_ext(const char *ext) {
+  int len = strlen(ext);
+  for (const char *s = g_isa_string; *s; s++)
+    if (*s == '_' && memcmp(s + 1, ext, len) == 0 && (s[len + 1] == '_' || s[len + 1] == 0))
+      return 1;
+  return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _SPIKE_ISA_H_
+#define _SPIKE_ISA_H_
+
+#include "util/types.h"
+
+// the ISA string of the harts, taken from "riscv,isa" of the first cpu node of the DTS,
+// e.g., "rv64imafdc_zicntr_sstc". empty if there is none.
+#define ISA_STRING_MAX 256
+extern char g_isa_string[ISA_STRING_MAX];
+
+void query_isa(uint64 fdt);
+int isa_has_ext(const char *ext);
+
+#endif
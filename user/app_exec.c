@@ -0,0 +1,35 @@
+/*
+ * This app runs obj/app_hello (built next to it) in three ways: it spawns it as a
+ * child, a forked child execs it, and finally it execs it itself, which prints the
+ * greeting in place of our last line. exec and spawn of a missing file fail with -1,
+ * and leave the caller as it was.
+ */
+
+#include "user/user_lib.h"
+#include "util/types.h"
+
+int flag;
+int main(void) {
+    flag = 7;
+    int pid = spawn("obj/app_hello");
+    wait(pid);
+    printu("spawned child %d exited.\n", pid);
+
+    printu("spawn of a missing file returns %d (expected -1).\n", spawn("obj/app_missing"));
+    printu("exec of a missing file returns %d (expected -1), flag = %d (expected 7).\n",
+           exec("obj/app_missing"), flag);
+
+    pid = fork();
+    if (pid == 0) {
+        exec("obj/app_hello");
+        printu("child: exec returned, which it should not.\n");
+        exit(1);
+    }
+    wait(pid);
+    printu("forked child %d exec'ed app_hello and exited.\n", pid);
+
+    exec("obj/app_hello");
+    printu("exec returned, which it should not.\n");
+    exit(1);
+    return 0;
+}
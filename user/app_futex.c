@@ -0,0 +1,87 @@
+/*
+ * This app exercises the futex syscall and the locks built on it. futex_wait returns
+ * -1 right away if the word does not hold the expected value, and -1 when it times
+ * out, even for a timeout shorter than a tick of the timer. a thread blocked on a
+ * word is woken up by futex_wake. a producer and a consumer pass numbers through a
+ * bounded buffer guarded by semaphores, and the consumer tells the main thread it is
+ * done through a condition variable. at last, a child blocked in futex_wait for ever
+ * is terminated by its alarm.
+ */
+
+#include "user/user_lib.h"
+#include "util/types.h"
+
+#define NR_ITEMS 100
+#define BUF_SIZE 4
+
+volatile int word;
+
+int waiter(void *arg) {
+    while (word == 0) futex_wait(&word, 0, 0);
+    return 0;
+}
+
+int buf[BUF_SIZE];
+sem_t empty, full;
+mutex_t lock;
+cond_t finished;
+int done, sum;
+
+int producer(void *arg) {
+    for (int i = 1; i <= NR_ITEMS; i++) {
+        sem_wait(&empty);
+        buf[i % BUF_SIZE] = i;
+        sem_post(&full);
+    }
+    return 0;
+}
+
+int consumer(void *arg) {
+    int s = 0;
+    for (int i = 1; i <= NR_ITEMS; i++) {
+        sem_wait(&full);
+        s += buf[i % BUF_SIZE];
+        sem_post(&empty);
+    }
+    mutex_lock(&lock);
+    sum = s;
+    done = 1;
+    cond_signal(&finished);
+    mutex_unlock(&lock);
+    return 0;
+}
+
+int main(void) {
+    printu("futex_wait on a changed word returns %d (expected -1).\n", futex_wait(&word, 1, 0));
+    printu("futex_wait for 1ns returns %d (expected -1).\n", futex_wait(&word, 0, 1));
+    printu("futex_wait for 10ms returns %d (expected -1).\n", futex_wait(&word, 0, 10000000));
+
+    int tid = thread_create(waiter, NULL);
+    sleep(1);
+    word = 1;
+    printu("futex_wake woke up %d waiter(s) (expected 1).\n", futex_wake(&word, 1));
+    thread_join(tid);
+
+    sem_init(&empty, BUF_SIZE);
+    sem_init(&full, 0);
+    int ptid = thread_create(producer, NULL);
+    int ctid = thread_create(consumer, NULL);
+    mutex_lock(&lock);
+    while (!done) cond_wait(&finished, &lock);
+    mutex_unlock(&lock);
+    thread_join(ptid);
+    thread_join(ctid);
+    printu("consumer received a sum of %d (expected %d).\n", sum, NR_ITEMS * (NR_ITEMS + 1) / 2);
+
+    int pid = fork();
+    if (pid == 0) {
+        alarm(1);
+        futex_wait(&word, 1, 0);
+        printu("child: futex_wait returned, which it should not.\n");
+        exit(1);
+    }
+    wait(pid);
+    printu("child %d blocked in futex_wait was terminated by its alarm.\n", pid);
+    exit(0);
+    return 0;
+}
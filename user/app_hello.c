@@ -0,0 +1,13 @@
+/*
+ * This app prints a greeting and exits. it is run by app_exec and app_vfork, through
+ * exec and spawn.
+ */
+
+#include "user/user_lib.h"
+#include "util/types.h"
+
+int main(void) {
+    printu("Hello from app_hello!\n");
+    exit(0);
+    return 0;
+}
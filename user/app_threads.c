@@ -0,0 +1,79 @@
+/*
+ * This app runs threads in the address space of the main thread. four threads add
+ * to a shared counter under a mutex, and are joined. then a page is freed while a
+ * thread that has read it still runs on another hart, so its translation must be
+ * shot down before the page is reused. at last, the main thread exits while two
+ * threads are still running, one spinning and one blocked, which ends them too.
+ */
+
+#include "user/user_lib.h"
+#include "util/types.h"
+
+#define NR_WORKERS 4
+#define ROUNDS 1000
+
+mutex_t lock;
+int counter;
+
+int worker(void *arg) {
+    for (int i = 0; i < ROUNDS; i++) {
+        mutex_lock(&lock);
+        counter++;
+        mutex_unlock(&lock);
+    }
+    return (int)(uint64)arg;
+}
+
+volatile int *shared_page;
+volatile int reader_stop, reader_done, reader_sum;
+
+// reads the shared page until told to stop, and then keeps running (with the page still
+// in the TLB of its hart) without touching it, until the page has been freed and reused.
+int reader(void *arg) {
+    while (!reader_stop) reader_sum = shared_page[0] + shared_page[1023];
+    reader_done = 1;
+    while (reader_stop != 2) ;
+    return 0;
+}
+
+volatile int spinning;
+volatile int never_set;
+
+int spinner(void *arg) {
+    for (;;) spinning = 1;
+    return 0;
+}
+
+int blocker(void *arg) {
+    futex_wait(&never_set, 0, 0);
+    printu("blocker: woke up, which it should not.\n");
+    return 1;
+}
+
+int main(void) {
+    int tid[NR_WORKERS];
+    for (int i = 0; i < NR_WORKERS; i++) tid[i] = thread_create(worker, (void *)(uint64)i);
+    for (int i = 0; i < NR_WORKERS; i++) thread_join(tid[i]);
+    printu("workers joined, counter = %d (expected %d).\n", counter, NR_WORKERS * ROUNDS);
+
+    shared_page = (int *)naive_malloc();
+    shared_page[0] = 1;
+    shared_page[1023] = 2;
+    int rt = thread_create(reader, NULL);
+    while (reader_sum != 3) yield();
+    reader_stop = 1;
+    while (!reader_done) yield();
+    naive_free((void *)shared_page);
+    int *page = (int *)naive_malloc();
+    page[0] = 5;
+    reader_stop = 2;
+    thread_join(rt);
+    printu("page freed under a running reader, reader saw %d (expected 3).\n", reader_sum);
+
+    thread_create(spinner, NULL);
+    thread_create(blocker, NULL);
+    while (!spinning) yield();
+    printu("main thread exits, ending a spinning and a blocked thread.\n");
+    exit(0);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * This app vforks three children, which run in its address space while it waits.
+ * the first one exits without exec: its write to a global variable is seen by the
+ * parent (unlike after fork), and the locals of the parent are intact. the second
+ * one fails to exec a missing file and exits, and the third one execs obj/app_hello.
+ */
+
+#include "user/user_lib.h"
+#include "util/types.h"
+
+int shared;
+int main(void) {
+    int local = 42;
+    shared = 0;
+    int pid = vfork();
+    if (pid == 0) {
+        shared = 1;
+        exit(0);
+    }
+    wait(pid);
+    printu("vfork child %d exited without exec, shared = %d (expected 1), local = %d "
+           "(expected 42).\n", pid, shared, local);
+
+    pid = vfork();
+    if (pid == 0) {
+        shared = exec("obj/app_missing");
+        exit(1);
+    }
+    wait(pid);
+    printu("vfork child %d failed to exec a missing file, exec returned %d (expected -1).\n",
+           pid, shared);
+
+    pid = vfork();
+    if (pid == 0) {
+        exec("obj/app_hello");
+        exit(1);
+    }
+    wait(pid);
+    printu("vfork child %d exec'ed app_hello and exited, local = %d (expected 42).\n", pid,
+           local);
+    exit(0);
+    return 0;
+}
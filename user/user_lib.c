@@ -12,13 +12,13 @@
 
 uint64 do_user_call(uint64 sysnum, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6,
                  uint64 a7) {
-  int ret;
+  uint64 ret;
 
   // before invoking the syscall, arguments of do_user_call are already loaded into the argument
   // registers (a0-a7) of our (emulated) risc-v machine.
   asm volatile(
       "ecall\n"
-      "sw a0, %0"  // returns a 32-bit value
+      "sd a0, %0"  // returns a 64-bit value, e.g., heap addresses above 4GB in Sv48
       : "=m"(ret)
       :
       : "memory");
@@ -83,4 +83,208 @@ void yield() {
 int wait(int pid)
 {
   return do_user_call(SYS_user_wait, (uint64)pid, 0, 0, 0, 0, 0, 0);
-}
\ No newline at end of file
+}
+
+//
+// lib call to memstat
+//
+int memstat(int pid, mem_stat *st) {
+  return do_user_call(SYS_user_memstat, (uint64)pid, (uint64)st, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to set_mergeable, lets the kernel merge identical pages of this process
+//
+int set_mergeable(int enable) {
+  return do_user_call(SYS_user_set_mergeable, (uint64)enable, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to zram_stat
+//
+int zram_stats(zram_stat *st) {
+  return do_user_call(SYS_user_zram_stat, (uint64)st, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to set_memlimit, limits (in pages) the memory charged to this process
+//
+int set_memlimit(uint64 soft, uint64 hard) {
+  return do_user_call(SYS_user_set_memlimit, soft, hard, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to setpriority, pid -1 for the calling process
+//
+int setpriority(int pid, int prio) {
+  return do_user_call(SYS_user_setpriority, (uint64)pid, (uint64)prio, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to sched_setattr, makes this process a real-time (EDF) one
+//
+int sched_setattr(uint64 runtime, uint64 deadline, uint64 period) {
+  return do_user_call(SYS_user_sched_setattr, runtime, deadline, period, 0, 0, 0, 0);
+}
+
+//
+// lib call to sched_stat
+//
+int sched_stats(int pid, sched_stat *st) {
+  return do_user_call(SYS_user_sched_stat, (uint64)pid, (uint64)st, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to sched_setaffinity, pid -1 for the calling process
+//
+int sched_setaffinity(int pid, uint64 mask) {
+  return do_user_call(SYS_user_sched_setaffinity, (uint64)pid, mask, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to nanosleep
+//
+int nanosleep(uint64 ns) {
+  return do_user_call(SYS_user_nanosleep, ns, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// sleep for "seconds" seconds
+//
+int sleep(uint64 seconds) {
+  return nanosleep(seconds * 1000000000UL);
+}
+
+//
+// lib call to alarm: the process is terminated in "seconds" seconds, 0 cancels
+//
+int alarm(uint64 seconds) {
+  return do_user_call(SYS_user_alarm, seconds, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// the first function of a thread: runs fn(arg), and exits the thread with its result.
+//
+static void thread_start(int (*fn)(void *), void *arg) {
+  exit(fn(arg));
+}
+
+//
+// lib call to clone: run fn(arg) in a new thread, which shares the memory of the caller.
+// returns the id of the thread, or -1.
+//
+int thread_create(int (*fn)(void *), void *arg) {
+  return do_user_call(SYS_user_clone, (uint64)thread_start, (uint64)fn, (uint64)arg, 0, 0, 0, 0);
+}
+
+//
+// wait for the thread "tid", created by the caller, to exit
+//
+int thread_join(int tid) {
+  return wait(tid);
+}
+
+//
+// lib call to futex: block while *addr holds val, for at most timeout_ns (0 for ever)
+//
+int futex_wait(volatile int *addr, int val, uint64 timeout_ns) {
+  return do_user_call(SYS_user_futex, (uint64)addr, FUTEX_WAIT, val, timeout_ns, 0, 0, 0);
+}
+
+//
+// lib call to futex: wake up to n processes waiting on addr
+//
+int futex_wake(volatile int *addr, int n) {
+  return do_user_call(SYS_user_futex, (uint64)addr, FUTEX_WAKE, n, 0, 0, 0, 0);
+}
+
+//
+// lock m. an uncontended lock takes one atomic operation. otherwise m is marked as
+// having waiters (2), and we wait in the kernel until we are the one to take it.
+//
+void mutex_lock(mutex_t *m) {
+  int c = 0;
+  if (__atomic_compare_exchange_n(&m->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  if (c != 2) c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while (c != 0) {
+    futex_wait(&m->state, 2, 0);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+//
+// unlock m, entering the kernel only if someone may wait for it.
+//
+void mutex_unlock(mutex_t *m) {
+  if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2) futex_wake(&m->state, 1);
+}
+
+//
+// unlock m and wait for c to be signalled, then lock m again. as with any condition
+// variable, the condition is to be checked again on return.
+//
+void cond_wait(cond_t *c, mutex_t *m) {
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+  mutex_unlock(m);
+  // a signal after the unlock changed seq, and the wait returns right away.
+  futex_wait(&c->seq, seq, 0);
+  mutex_lock(m);
+}
+
+void cond_signal(cond_t *c) {
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 1);
+}
+
+void cond_broadcast(cond_t *c) {
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+void sem_init(sem_t *s, int count) {
+  s->count = count;
+  s->waiters = 0;
+}
+
+//
+// take one unit of s, waiting in the kernel while there is none.
+//
+void sem_wait(sem_t *s) {
+  while (1) {
+    int c = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    if (c > 0) {
+      if (__atomic_compare_exchange_n(&s->count, &c, c - 1, 0, __ATOMIC_ACQUIRE,
+                                      __ATOMIC_RELAXED))
+        return;
+      continue;
+    }
+    __atomic_add_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+    futex_wait(&s->count, 0, 0);
+    __atomic_sub_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+//
+// give one unit back to s, entering the kernel only if someone waits for it.
+//
+void sem_post(sem_t *s) {
+  __atomic_add_fetch(&s->count, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST)) futex_wake(&s->count, 1);
+}
+
+//
+// lib call to exec: run the program at "path" (on the host) instead. returns only if it
+// fails.
+//
+int exec(const char *path) {
+  return do_user_call(SYS_user_exec, (uint64)path, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// lib call to spawn: run the program at "path" (on the host) in a new child process.
+// returns its pid, or -1.
+//
+int spawn(const char *path) {
+  return do_user_call(SYS_user_spawn, (uint64)path, 0, 0, 0, 0, 0, 0);
+}
@@ -2,6 +2,9 @@
  * header file to be used by applications.
  */
 
+#include "util/types.h"
+#include "kernel/syscall.h"
+
 int printu(const char *s, ...);
 int exit(int code);
 void* naive_malloc();
@@ -9,3 +12,54 @@ void naive_free(void* va);
 int fork();
 void yield();
 int wait(int);
+int memstat(int pid, mem_stat *st);
+int set_mergeable(int enable);
+int zram_stats(zram_stat *st);
+int set_memlimit(uint64 soft, uint64 hard);
+int setpriority(int pid, int prio);
+int sched_setattr(uint64 runtime, uint64 deadline, uint64 period);
+int sched_stats(int pid, sched_stat *st);
+int sched_setaffinity(int pid, uint64 mask);
+int nanosleep(uint64 ns);
+int sleep(uint64 seconds);
+int alarm(uint64 seconds);
+int exec(const char *path);
+int spawn(const char *path);
+int thread_create(int (*fn)(void *), void *arg);
+int thread_join(int tid);
+
+// vfork: the child runs on the stack of the caller until it execs or exits, so vfork must
+// not leave a stack frame of its own for the child to overwrite. it is inlined into the
+// caller, whose frame the child must not return from.
+static inline __attribute__((always_inline)) int vfork() {
+  register uint64 a0 asm("a0") = SYS_user_vfork;
+  asm volatile("ecall" : "+r"(a0) : : "memory");
+  return a0;
+}
+
+int futex_wait(volatile int *addr, int val, uint64 timeout_ns);
+int futex_wake(volatile int *addr, int n);
+
+// locks that enter the kernel only when contended. all zero is their initial state.
+// a mutex: 0 unlocked, 1 locked, 2 locked with waiters
+typedef struct mutex_t {
+  volatile int state;
+} mutex_t;
+// a condition variable, woken up by a change of its sequence number
+typedef struct cond_t {
+  volatile int seq;
+} cond_t;
+// a counting semaphore
+typedef struct sem_t {
+  volatile int count;
+  volatile int waiters;
+} sem_t;
+
+void mutex_lock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
+void cond_wait(cond_t *c, mutex_t *m);
+void cond_signal(cond_t *c);
+void cond_broadcast(cond_t *c);
+void sem_init(sem_t *s, int count);
+void sem_wait(sem_t *s);
+void sem_post(sem_t *s);
@@ -38,6 +38,25 @@ void* memset(void* dest, int byte, size_t len) {
   return dest;
 }
 
+int memcmp(const void* s1, const void* s2, size_t len) {
+  const unsigned char* a = s1;
+  const unsigned char* b = s2;
+
+  if ((((uintptr_t)s1 | (uintptr_t)s2 | len) & (sizeof(uintptr_t) - 1)) == 0) {
+    // skip over equal words, then compare the first differing word bytewise.
+    while (len && *(const uintptr_t*)a == *(const uintptr_t*)b) {
+      a += sizeof(uintptr_t);
+      b += sizeof(uintptr_t);
+      len -= sizeof(uintptr_t);
+    }
+  }
+
+  for (; len; len--, a++, b++)
+    if (*a != *b) return *a - *b;
+
+  return 0;
+}
+
 size_t strlen(const char* s) {
   const char* p = s;
   while (*p) p++;